@@ -0,0 +1,788 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include "../../src/ordered_set/avl_tree.hpp"
+#include "../../src/ordered_set/b_tree.hpp"
+#include "../../src/ordered_set/be_tree.hpp"
+#include "../../src/ordered_set/compressed_b_tree.hpp"
+#include "../../src/ordered_set/lsm_tree.hpp"
+#include "../../src/ordered_set/splay_tree.hpp"
+#include "../../src/ordered_set/two_three_tree.hpp"
+#include "../../src/ordered_set/stl_ordered_set.hpp"
+#include "../../src/ordered_set/static_search_tree.hpp"
+#include "../../src/ordered_set/pgm_index.hpp"
+#include "../../src/ordered_set/elias_fano.hpp"
+#include "../../src/ordered_set/static_ordered_set.hpp"
+#include "../../src/ordered_set/sharded_ordered_set.hpp"
+#include "../../src/ordered_set/filtered_ordered_set.hpp"
+#include "../../src/ordered_set/roaring_set.hpp"
+#include "../../src/ordered_set/concurrent.hpp"
+#include "../../src/ordered_set/paged_b_tree.hpp"
+#include "../../src/ordered_set/adaptive_ordered_set.hpp"
+
+#include "perf_counters.hpp"
+
+using key_type = uint64_t;
+
+static std::vector<key_type> random_keys(size_t size, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<key_type> dist(
+        std::numeric_limits<key_type>::min(),
+        std::numeric_limits<key_type>::max()
+    );
+
+    std::vector<key_type> keys(size);
+    for (auto& key : keys) {
+        key = dist(rng);
+    }
+    return keys;
+}
+
+// Static sets are built from the sorted keys, the others by insertion.
+template <class OrderedSet>
+static OrderedSet make_set(std::vector<key_type> keys) {
+    if constexpr (std::is_constructible_v<OrderedSet, std::vector<key_type>>) {
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        return OrderedSet(keys);
+    } else {
+        OrderedSet set;
+        for (const auto key : keys) {
+            set.insert(key);
+        }
+        return set;
+    }
+}
+
+// Counts the hardware events of the scope it lives in, normally the timed
+// loop, and adds them to the benchmark on the way out, per iteration, along
+// with instructions per cycle. Counters the machine does not offer are left
+// out, so without perf support only the timings are reported.
+class PerfScope {
+    benchmark::State& m_state;
+    PerfCounters m_perf;
+
+public:
+    explicit PerfScope(benchmark::State& state) : m_state(state) {
+        m_perf.start();
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+    ~PerfScope() {
+        m_perf.stop();
+        for (size_t event = 0; event < PerfCounters::EVENTS; ++event) {
+            if (auto count = m_perf.get(static_cast<PerfCounters::Event>(event))) {
+                m_state.counters[PerfCounters::NAMES[event]] = benchmark::Counter(
+                    *count, benchmark::Counter::kAvgIterations
+                );
+            }
+        }
+
+        auto cycles = m_perf.get(PerfCounters::Cycles);
+        auto instructions = m_perf.get(PerfCounters::Instructions);
+        if (cycles.has_value() && instructions.has_value() && *cycles > 0) {
+            m_state.counters["ipc"] = *instructions / *cycles;
+        }
+    }
+};
+
+// Half of the queries hit and half of them miss.
+static std::vector<key_type> make_queries(const std::vector<key_type>& keys) {
+    auto queries = random_keys(keys.size(), 1);
+    for (size_t i = 0; i < queries.size(); i += 2) {
+        queries[i] = keys[i];
+    }
+    std::shuffle(queries.begin(), queries.end(), std::mt19937_64(2));
+    return queries;
+}
+
+// Runs of keys with small random gaps, starting at random points.
+static std::vector<key_type> clustered_keys(size_t size, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<key_type> keys(size);
+    key_type key = 0;
+    for (size_t i = 0; i < size; ++i) {
+        key = i % 4096 == 0 ? rng() : key + 1 + rng() % 16;
+        keys[i] = key;
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+// Queries drawn from the keys with a Zipfian distribution of the given skew,
+// where the hot keys are spread randomly over the key space.
+static std::vector<key_type> make_zipf_queries(const std::vector<key_type>& keys, double skew) {
+    std::vector<double> cdf(keys.size());
+    double total = 0;
+    for (size_t rank = 0; rank < keys.size(); ++rank) {
+        total += 1 / std::pow(rank + 1, skew);
+        cdf[rank] = total;
+    }
+
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> dist(0, total);
+    std::vector<key_type> queries(1 << 20);
+    for (auto& query : queries) {
+        auto rank = std::lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin();
+        query = keys[std::min<size_t>(rank, keys.size() - 1)];
+    }
+    return queries;
+}
+
+template <class OrderedSet>
+static void BM_Contains(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    const auto set = make_set<OrderedSet>(keys);
+    const auto queries = make_queries(keys);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.contains(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// The same queries as BM_Contains, in increasing order, so that the path
+// through the set changes little from one lookup to the next.
+template <class OrderedSet>
+static void BM_ContainsSequential(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    const auto set = make_set<OrderedSet>(keys);
+    auto queries = make_queries(keys);
+    std::sort(queries.begin(), queries.end());
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.contains(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// BM_Contains on a tree whose nodes come from pages of the given kind, to
+// compare the dTLB misses per lookup with and without huge pages.
+template <class OrderedSet, Pages Kind>
+static void BM_ContainsPages(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    OrderedSet set(Kind);
+    for (const auto key : keys) {
+        set.insert(key);
+    }
+    const auto queries = make_queries(keys);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.contains(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <class OrderedSet>
+static void BM_Predecessor(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    const auto set = make_set<OrderedSet>(keys);
+    const auto queries = make_queries(keys);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.predecessor(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <class OrderedSet>
+static void BM_Successor(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    const auto set = make_set<OrderedSet>(keys);
+    const auto queries = make_queries(keys);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.successor(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Lookups of clustered keys, half of them absent, with the memory per key
+// for sets that report it.
+template <class OrderedSet>
+static void BM_ContainsClustered(benchmark::State& state) {
+    const auto keys = clustered_keys(state.range(0), 0);
+    const auto set = make_set<OrderedSet>(keys);
+
+    auto queries = keys;
+    for (size_t i = 0; i < queries.size(); i += 2) {
+        queries[i] += 1;
+    }
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.contains(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if constexpr (requires { set.memory(); }) {
+        state.counters["bytes_per_key"] = double(set.memory()) / set.size();
+    }
+}
+
+// Lookups where range(1) percent of the queries miss.
+template <class OrderedSet>
+static void BM_ContainsMisses(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    const auto set = make_set<OrderedSet>(keys);
+
+    auto queries = random_keys(keys.size(), 1);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (i % 100 >= static_cast<size_t>(state.range(1))) queries[i] = keys[i];
+    }
+    std::shuffle(queries.begin(), queries.end(), std::mt19937_64(2));
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.contains(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Lookups of a random set with skew range(1) / 100. The set is not const
+// because self-adjusting trees restructure on reads.
+template <class OrderedSet>
+static void BM_ZipfContains(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    auto set = make_set<OrderedSet>(keys);
+    const auto queries = make_zipf_queries(keys, state.range(1) / 100.0);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(set.contains(queries[i]));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Steady state churn: each iteration removes a key and inserts a new one.
+template <class OrderedSet>
+static void BM_Churn(benchmark::State& state) {
+    auto keys = random_keys(state.range(0), 0);
+    auto set = make_set<OrderedSet>(keys);
+    const auto fresh = random_keys(1 << 20, 1);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            auto& key = keys[i % keys.size()];
+            set.remove(key);
+            key = fresh[i % fresh.size()] ^ i;
+            set.insert(key);
+            ++i;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    // Messages moved down a level per update, for the buffered trees.
+    if constexpr (requires { set.flushed(); }) {
+        state.counters["flushed"] = benchmark::Counter(
+            set.flushed(), benchmark::Counter::kAvgIterations
+        );
+    }
+}
+
+// Each iteration ingests a new batch of random keys into a growing set.
+template <class OrderedSet>
+static void BM_InsertBatch(benchmark::State& state) {
+    OrderedSet set;
+    unsigned seed = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        const auto keys = random_keys(state.range(0), seed++);
+        state.ResumeTiming();
+
+        if constexpr (requires { set.insert_batch(keys); }) {
+            set.insert_batch(keys);
+        } else {
+            for (const auto key : keys) {
+                set.insert(key);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Sustained random inserts into a growing set, one per iteration.
+template <class OrderedSet>
+static void BM_Ingest(benchmark::State& state) {
+    OrderedSet set;
+    const auto keys = random_keys(1 << 22, 0);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            set.insert(keys[i]);
+            if (++i == keys.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// The InsertInc and InsertDec patterns from the tests, with one insert per
+// iteration into a growing set, either from the root or through a finger.
+template <class OrderedSet, bool Increasing, bool Hinted>
+static void BM_InsertSequential(benchmark::State& state) {
+    OrderedSet set;
+    typename OrderedSet::Finger finger;
+    key_type key = Increasing ? 0 : std::numeric_limits<key_type>::max();
+
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            if constexpr (Hinted) {
+                set.insert(finger, key);
+            } else {
+                set.insert(key);
+            }
+            key = Increasing ? key + 1 : key - 1;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Builds a set from unsorted keys with duplicates, either one insert() at a
+// time or with build_parallel() on the given number of threads.
+template <class OrderedSet>
+static void BM_Build(benchmark::State& state) {
+    auto keys = random_keys(state.range(0), 0);
+    for (size_t i = 0; i < keys.size(); i += 4) {
+        keys[i] = keys[i / 2];
+    }
+
+    const auto threads = state.range(1);
+    for (auto _ : state) {
+        OrderedSet set;
+        if (threads == 0) {
+            for (const auto key : keys) {
+                set.insert(key);
+            }
+        } else {
+            set.build_parallel(keys.begin(), keys.end(), threads);
+        }
+        benchmark::DoNotOptimize(set.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Snapshots a set, either with clone() or by inserting its keys into a new
+// set, which is what copying took before.
+template <class OrderedSet, bool Clone>
+static void BM_Snapshot(benchmark::State& state) {
+    const auto set = make_set<OrderedSet>(random_keys(state.range(0), 0));
+    for (auto _ : state) {
+        if constexpr (Clone) {
+            auto copy = set.clone();
+            benchmark::DoNotOptimize(copy.size());
+        } else {
+            OrderedSet copy;
+            for (const auto key : sorted_keys(set)) {
+                copy.insert(key);
+            }
+            benchmark::DoNotOptimize(copy.size());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <class OrderedSet>
+static void BM_CountRange(benchmark::State& state) {
+    const auto keys = random_keys(state.range(0), 0);
+    const auto set = make_set<OrderedSet>(keys);
+    const auto queries = make_queries(keys);
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            const auto lo = std::min(queries[i], queries[i+1]);
+            const auto hi = std::max(queries[i], queries[i+1]);
+            benchmark::DoNotOptimize(set.count_range(lo, hi));
+            i += 2;
+            if (i + 1 >= queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Scans of range(1) consecutive keys from random points of a paged tree of
+// range(0) keys, whose buffer pool holds about a sixteenth of its pages,
+// with the pages read in per scan.
+static void BM_PagedScan(benchmark::State& state) {
+    auto keys = random_keys(state.range(0), 0);
+    PagedBTree<> set(keys.size() * sizeof(key_type) / 16);
+    for (const auto key : keys) {
+        set.insert(key);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::mt19937_64 rng(1);
+    const auto length = static_cast<size_t>(state.range(1));
+    const auto reads = set.reads();
+    size_t scanned = 0;
+    for (auto _ : state) {
+        const auto first = rng() % (keys.size() - length);
+        set.scan(keys[first], keys[first + length], [&scanned](key_type) { ++scanned; });
+    }
+    state.SetItemsProcessed(scanned);
+    state.counters["reads"] = benchmark::Counter(set.reads() - reads, benchmark::Counter::kAvgIterations);
+}
+
+// The distinct keys of a table fixed at compile time, from splitmix64.
+template <size_t N>
+static constexpr std::array<key_type, N> table_keys() {
+    std::array<key_type, N> keys{};
+    key_type state = 0;
+    for (auto& key : keys) {
+        state += 0x9e3779b97f4a7c15;
+        auto z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        key = z ^ (z >> 31);
+    }
+    return keys;
+}
+
+// Lookups in a table of N keys known at compile time, about half of them
+// misses. StaticOrderedSet holds the table as a constant, the others build
+// it at startup.
+template <class OrderedSet, size_t N>
+static void BM_ContainsTable(benchmark::State& state) {
+    static constexpr auto keys = table_keys<N>();
+
+    auto measure = [&state](const auto& set) {
+        std::mt19937_64 rng(1);
+        std::vector<key_type> queries(1 << 12);
+        for (auto& query : queries) {
+            query = keys[rng() % N] + rng() % 2;
+        }
+
+        size_t i = 0;
+        {
+            PerfScope perf(state);
+            for (auto _ : state) {
+                benchmark::DoNotOptimize(set.contains(queries[i]));
+                if (++i == queries.size()) i = 0;
+            }
+        }
+        state.SetItemsProcessed(state.iterations());
+    };
+
+    if constexpr (std::is_same_v<OrderedSet, StaticOrderedSet<N>>) {
+        static constexpr OrderedSet set(keys);
+        measure(set);
+    } else {
+        measure(make_set<OrderedSet>(std::vector<key_type>(keys.begin(), keys.end())));
+    }
+}
+
+// A scheduling queue: each iteration takes the 64 smallest keys and adds as
+// many new ones later than all the others, taking them either one at a time
+// by successor() and remove(), or all at once by pop_min().
+template <class OrderedSet, bool Batch>
+static void BM_PopMin(benchmark::State& state) {
+    const size_t run = 64;
+    auto keys = random_keys(state.range(0), 0);
+    for (auto& key : keys) {
+        key >>= 1;
+    }
+    auto set = make_set<OrderedSet>(keys);
+    auto next = key_type(1) << 63;
+
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            if constexpr (Batch) {
+                benchmark::DoNotOptimize(set.pop_min(run));
+            } else {
+                for (size_t j = 0; j < run; ++j) {
+                    auto key = set.contains(0) ? 0 : *set.successor(0);
+                    set.remove(key);
+                    benchmark::DoNotOptimize(key);
+                }
+            }
+            for (size_t j = 0; j < run; ++j) {
+                set.insert(next++);
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * run);
+}
+
+// Lookups spread over 2^16 sets of a few keys each, about half of them
+// misses, along with the bytes each set takes, heap included where malloc
+// can tell.
+template <class OrderedSet>
+static void BM_SmallSets(benchmark::State& state) {
+    const size_t sets = 1 << 16;
+    const auto keys = random_keys(sets * state.range(0), 0);
+
+#ifdef __GLIBC__
+    const auto before = mallinfo2().uordblks;
+#endif
+    std::vector<OrderedSet> small(sets);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        small[i % sets].insert(keys[i]);
+    }
+#ifdef __GLIBC__
+    const auto bytes = mallinfo2().uordblks - before;
+    state.counters["bytes_per_set"] = static_cast<double>(bytes) / sets;
+#endif
+
+    std::mt19937_64 rng(1);
+    std::vector<std::pair<size_t, key_type>> queries(1 << 20);
+    for (auto& [set, key] : queries) {
+        const auto k = rng() % keys.size();
+        set = k % sets;
+        key = keys[k] + rng() % 2;
+    }
+
+    size_t i = 0;
+    {
+        PerfScope perf(state);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(small[queries[i].first].contains(queries[i].second));
+            if (++i == queries.size()) i = 0;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Threads share one set of 2^20 keys, with 80% lookups and 10% each of
+// inserts and removes over twice as many keys.
+template <class OrderedSet>
+static void BM_ConcurrentMixed(benchmark::State& state) {
+    static constexpr size_t SIZE = 1 << 20;
+    static OrderedSet* set;
+
+    if (state.thread_index() == 0) {
+        set = new OrderedSet();
+        for (const auto key : random_keys(SIZE, 0)) {
+            set->insert(key % (2 * SIZE));
+        }
+    }
+    const auto keys = random_keys(1 << 16, 1 + state.thread_index());
+
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto key = keys[i] % (2 * SIZE);
+        // The high bits pick the operation, independently of the key.
+        switch ((keys[i] >> 32) % 10) {
+            case 0:
+                set->insert(key);
+                break;
+            case 1:
+                set->remove(key);
+                break;
+            default:
+                benchmark::DoNotOptimize(set->contains(key));
+                break;
+        }
+        if (++i == keys.size()) i = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    if (state.thread_index() == 0) {
+        delete set;
+    }
+}
+
+// From L1 resident up to well beyond the last level cache.
+#define QUERY_SIZES RangeMultiplier(8)->Range(1 << 10, 1 << 25)
+
+BENCHMARK_TEMPLATE(BM_Contains, AVLTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, TwoThreeTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, BfsSearchTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, VebSearchTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, PgmIndex<>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, EliasFano)->QUERY_SIZES;
+
+BENCHMARK_TEMPLATE(BM_ContainsSequential, AVLTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsSequential, TwoThreeTree)->QUERY_SIZES;
+
+#define PAGES_SIZES RangeMultiplier(8)->Range(1 << 16, 1 << 22)
+BENCHMARK_TEMPLATE(BM_ContainsPages, AVLTree, Pages::Normal)->PAGES_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsPages, AVLTree, Pages::Huge)->PAGES_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsPages, TwoThreeTree, Pages::Normal)->PAGES_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsPages, TwoThreeTree, Pages::Huge)->PAGES_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsPages, BTree, Pages::Normal)->PAGES_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsPages, BTree, Pages::Huge)->PAGES_SIZES;
+
+BENCHMARK_TEMPLATE(BM_Predecessor, AVLTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Predecessor, BTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Predecessor, TwoThreeTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Predecessor, BfsSearchTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Predecessor, VebSearchTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Predecessor, PgmIndex<>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Predecessor, EliasFano)->QUERY_SIZES;
+
+BENCHMARK_TEMPLATE(BM_Successor, AVLTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Successor, BTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Successor, TwoThreeTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Successor, BfsSearchTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Successor, VebSearchTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Successor, PgmIndex<>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Successor, EliasFano)->QUERY_SIZES;
+
+BENCHMARK_TEMPLATE(BM_ContainsTable, AVLTree, 8);
+BENCHMARK_TEMPLATE(BM_ContainsTable, AVLTree, 64);
+BENCHMARK_TEMPLATE(BM_ContainsTable, AVLTree, 512);
+BENCHMARK_TEMPLATE(BM_ContainsTable, StaticOrderedSet<8>, 8);
+BENCHMARK_TEMPLATE(BM_ContainsTable, StaticOrderedSet<64>, 64);
+BENCHMARK_TEMPLATE(BM_ContainsTable, StaticOrderedSet<512>, 512);
+
+#define POP_SIZES RangeMultiplier(32)->Range(1 << 10, 1 << 20)
+BENCHMARK_TEMPLATE(BM_PopMin, AVLTree, false)->POP_SIZES;
+BENCHMARK_TEMPLATE(BM_PopMin, AVLTree, true)->POP_SIZES;
+BENCHMARK_TEMPLATE(BM_PopMin, BTree, false)->POP_SIZES;
+BENCHMARK_TEMPLATE(BM_PopMin, BTree, true)->POP_SIZES;
+
+#define SMALL_SIZES Arg(2)->Arg(8)->Arg(32)->Arg(128)
+BENCHMARK_TEMPLATE(BM_SmallSets, AVLTree)->SMALL_SIZES;
+BENCHMARK_TEMPLATE(BM_SmallSets, BTree)->SMALL_SIZES;
+BENCHMARK_TEMPLATE(BM_SmallSets, AdaptiveOrderedSet<>)->SMALL_SIZES;
+
+BENCHMARK_TEMPLATE(BM_Contains, PagedBTree<>)->RangeMultiplier(8)->Range(1 << 10, 1 << 22);
+BENCHMARK(BM_PagedScan)->Args({1 << 20, 1 << 12});
+
+#define CLUSTERED_SIZES RangeMultiplier(16)->Range(1 << 14, 1 << 22)
+
+BENCHMARK_TEMPLATE(BM_ContainsClustered, BTree)->CLUSTERED_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsClustered, CompressedBTree<>)->CLUSTERED_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsClustered, RoaringSet)->CLUSTERED_SIZES;
+BENCHMARK_TEMPLATE(BM_ContainsClustered, EliasFano)->CLUSTERED_SIZES;
+
+#define MISS_ARGS ArgsProduct({{1 << 16, 1 << 20}, {0, 25, 50, 75, 90, 99}})
+
+BENCHMARK_TEMPLATE(BM_ContainsMisses, BTree)->MISS_ARGS;
+BENCHMARK_TEMPLATE(BM_ContainsMisses, FilteredOrderedSet<BTree>)->MISS_ARGS;
+BENCHMARK_TEMPLATE(BM_ContainsMisses, AVLTree)->MISS_ARGS;
+BENCHMARK_TEMPLATE(BM_ContainsMisses, FilteredOrderedSet<AVLTree>)->MISS_ARGS;
+
+#define ZIPF_ARGS ArgsProduct({{1 << 20}, {0, 50, 80, 99, 120, 150}})
+
+BENCHMARK_TEMPLATE(BM_ZipfContains, AVLTree)->ZIPF_ARGS;
+BENCHMARK_TEMPLATE(BM_ZipfContains, SplayTree<>)->ZIPF_ARGS;
+BENCHMARK_TEMPLATE(BM_ZipfContains, SplayTree<true>)->ZIPF_ARGS;
+
+#define CONCURRENT_THREADS ThreadRange(1, 64)->UseRealTime()
+
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Locked<AVLTree>)->CONCURRENT_THREADS;
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Concurrent<AVLTree>)->CONCURRENT_THREADS;
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Locked<BTree>)->CONCURRENT_THREADS;
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Concurrent<BTree>)->CONCURRENT_THREADS;
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Locked<TwoThreeTree>)->CONCURRENT_THREADS;
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Concurrent<TwoThreeTree>)->CONCURRENT_THREADS;
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Locked<StlOrderedSet>)->CONCURRENT_THREADS;
+BENCHMARK_TEMPLATE(BM_ConcurrentMixed, Concurrent<StlOrderedSet>)->CONCURRENT_THREADS;
+
+BENCHMARK_TEMPLATE(BM_InsertBatch, BTree)->Arg(1 << 16)->Iterations(64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_InsertBatch, AVLTree)->Arg(1 << 16)->Iterations(64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_InsertBatch, ShardedOrderedSet<BTree>)->Arg(1 << 16)->Iterations(64)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_InsertBatch, ShardedOrderedSet<AVLTree>)->Arg(1 << 16)->Iterations(64)->UseRealTime();
+
+#define INGEST_ITERATIONS Iterations(1 << 22)->UseRealTime()
+
+BENCHMARK_TEMPLATE(BM_Ingest, BTree)->INGEST_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_Ingest, AVLTree)->INGEST_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_Ingest, BeTree<>)->INGEST_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_Ingest, LsmTree<BTree>)->INGEST_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_Ingest, LsmTree<AVLTree>)->INGEST_ITERATIONS;
+
+#define SNAPSHOT_SIZES RangeMultiplier(16)->Range(1 << 12, 1 << 20)
+
+BENCHMARK_TEMPLATE(BM_Snapshot, BTree, true)->SNAPSHOT_SIZES;
+BENCHMARK_TEMPLATE(BM_Snapshot, BTree, false)->SNAPSHOT_SIZES;
+BENCHMARK_TEMPLATE(BM_Snapshot, AVLTree, true)->SNAPSHOT_SIZES;
+BENCHMARK_TEMPLATE(BM_Snapshot, AVLTree, false)->SNAPSHOT_SIZES;
+BENCHMARK_TEMPLATE(BM_Snapshot, TwoThreeTree, true)->SNAPSHOT_SIZES;
+BENCHMARK_TEMPLATE(BM_Snapshot, TwoThreeTree, false)->SNAPSHOT_SIZES;
+
+BENCHMARK_TEMPLATE(BM_CountRange, BTree)->QUERY_SIZES;
+
+BENCHMARK_TEMPLATE(BM_Churn, BTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Churn, AVLTree)->QUERY_SIZES;
+
+// Larger buffers batch more updates per flush, but queries scan more
+// messages on the way down.
+BENCHMARK_TEMPLATE(BM_Churn, BeTree<16, 64, 64>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Churn, BeTree<16, 64, 256>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Churn, BeTree<16, 64, 1024>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, BTree)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, BeTree<16, 64, 64>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, BeTree<16, 64, 256>)->QUERY_SIZES;
+BENCHMARK_TEMPLATE(BM_Contains, BeTree<16, 64, 1024>)->QUERY_SIZES;
+
+#define SEQUENTIAL_ITERATIONS Iterations(1 << 22)
+
+BENCHMARK_TEMPLATE(BM_InsertSequential, BTree, true, false)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, BTree, true, true)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, BTree, false, false)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, BTree, false, true)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, AVLTree, true, false)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, AVLTree, true, true)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, AVLTree, false, false)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, AVLTree, false, true)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, TwoThreeTree, true, false)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, TwoThreeTree, true, true)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, TwoThreeTree, false, false)->SEQUENTIAL_ITERATIONS;
+BENCHMARK_TEMPLATE(BM_InsertSequential, TwoThreeTree, false, true)->SEQUENTIAL_ITERATIONS;
+
+#define BUILD_ARGS ArgsProduct({{1 << 22}, {0, 1, 4, 16, 64}})->Iterations(1)->UseRealTime()
+
+BENCHMARK_TEMPLATE(BM_Build, BTree)->BUILD_ARGS;
+BENCHMARK_TEMPLATE(BM_Build, AVLTree)->BUILD_ARGS;
+BENCHMARK_TEMPLATE(BM_Build, TwoThreeTree)->BUILD_ARGS;
+
+BENCHMARK_MAIN();
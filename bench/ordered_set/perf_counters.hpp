@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware counters of the calling thread, read through perf_event_open
+// around a measured phase. The counters are opened as one group led by the
+// first that opens, so the PMU schedules them together and their ratios come
+// from the same stretch of time. One the CPU or the kernel does not offer is
+// simply missing, and counts are scaled up when the group as a whole was
+// multiplexed with other users of the PMU. Only user space is counted, which
+// is what perf_event_paranoid allows by default.
+class PerfCounters {
+public:
+    enum Event {
+        Cycles,
+        Instructions,
+        L1dMisses,
+        LlcMisses,
+        DtlbMisses,
+        BranchMisses
+    };
+
+    static constexpr size_t EVENTS = 6;
+
+    static constexpr std::array<const char*, EVENTS> NAMES{
+        "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "branch_misses"
+    };
+
+private:
+    std::array<int, EVENTS> m_fds;
+    int m_leader = -1;
+    std::array<std::optional<double>, EVENTS> m_counts;
+
+#ifdef __linux__
+    static constexpr uint64_t cache_miss(uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    static int open(Event event, int group) {
+        static constexpr std::array<std::pair<uint32_t, uint64_t>, EVENTS> configs{{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_L1D)},
+            {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_LL)},
+            {PERF_TYPE_HW_CACHE, cache_miss(PERF_COUNT_HW_CACHE_DTLB)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        }};
+
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = configs[event].first;
+        attr.config = configs[event].second;
+        // Only the leader is disabled; the others follow it on and off.
+        attr.disabled = group < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+#endif
+
+public:
+    PerfCounters() {
+        for (size_t event = 0; event < EVENTS; ++event) {
+#ifdef __linux__
+            m_fds[event] = open(static_cast<Event>(event), m_leader);
+            if (m_leader < 0) m_leader = m_fds[event];
+#else
+            m_fds[event] = -1;
+#endif
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (const auto fd : m_fds) {
+            if (fd >= 0) close(fd);
+        }
+#endif
+    }
+
+    bool available() const {
+        for (const auto fd : m_fds) {
+            if (fd >= 0) return true;
+        }
+        return false;
+    }
+
+    // Zeroes the counters and starts counting.
+    void start() {
+#ifdef __linux__
+        if (m_leader < 0) return;
+        ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+    }
+
+    // Stops counting and reads the whole group at once.
+    void stop() {
+        m_counts.fill(std::nullopt);
+#ifdef __linux__
+        if (m_leader < 0) return;
+        ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // The number of counters, the time enabled, the time running and
+        // the values in the order the counters were opened.
+        std::array<uint64_t, 3 + EVENTS> values;
+        auto bytes = read(m_leader, values.data(), sizeof(values));
+        if (bytes < static_cast<ssize_t>(3 * sizeof(uint64_t)) || values[2] == 0) return;
+
+        size_t index = 3;
+        for (size_t event = 0; event < EVENTS; ++event) {
+            if (m_fds[event] < 0) continue;
+            if (index >= 3 + values[0]) break;
+            m_counts[event] = static_cast<double>(values[index++]) * values[1] / values[2];
+        }
+#endif
+    }
+
+    // The count between start() and stop(), or nothing if the event is not
+    // available or never got onto the PMU.
+    std::optional<double> get(Event event) const {
+        return m_counts[event];
+    }
+};
@@ -0,0 +1,190 @@
+// Replays a recorded operation trace against ordered set implementations,
+// reporting throughput and per-operation latency and checking every answer
+// against StlOrderedSet.
+//
+//   replay <trace> [implementation...]
+//   replay --generate <trace> <count> [seed]
+//
+// Without implementations all of them are run. The generated trace is a
+// mix of every operation over a key space a quarter the length of the
+// trace, which leaves the set about half full, for trying the tool without
+// a captured trace.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../src/ordered_set/avl_tree.hpp"
+#include "../../src/ordered_set/b_tree.hpp"
+#include "../../src/ordered_set/be_tree.hpp"
+#include "../../src/ordered_set/compressed_b_tree.hpp"
+#include "../../src/ordered_set/lsm_tree.hpp"
+#include "../../src/ordered_set/splay_tree.hpp"
+#include "../../src/ordered_set/two_three_tree.hpp"
+#include "../../src/ordered_set/stl_ordered_set.hpp"
+#include "../../src/ordered_set/sharded_ordered_set.hpp"
+#include "../../src/ordered_set/filtered_ordered_set.hpp"
+#include "../../src/ordered_set/roaring_set.hpp"
+#include "../../src/ordered_set/trace.hpp"
+
+using key_type = Trace::key_type;
+using Answers = std::vector<std::optional<key_type>>;
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    Answers answers;
+    double seconds;
+    std::array<std::vector<uint32_t>, OPS> latencies;
+};
+
+// Runs the trace twice on fresh sets: once untimed per operation for the
+// throughput and the answers, and once timing every operation on its own,
+// which adds the clock's overhead to each latency.
+template <class OrderedSet>
+static Result replay(const Trace& trace) {
+    Result result;
+    result.answers.resize(trace.size());
+    {
+        OrderedSet set;
+        auto start = Clock::now();
+        for (size_t i = 0; i < trace.size(); ++i) {
+            result.answers[i] = apply(set, trace.ops[i], trace.keys[i]);
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    OrderedSet set;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        auto start = Clock::now();
+        auto answer = apply(set, trace.ops[i], trace.keys[i]);
+        auto end = Clock::now();
+        asm volatile("" : : "r"(answer.has_value()) : "memory");
+        result.latencies[static_cast<size_t>(trace.ops[i])].push_back(std::chrono::nanoseconds(end - start).count());
+    }
+    return result;
+}
+
+static const std::vector<std::pair<std::string, std::function<Result(const Trace&)>>> IMPLEMENTATIONS{
+    {"stl", replay<StlOrderedSet>},
+    {"two_three", replay<TwoThreeTree>},
+    {"avl", replay<AVLTree>},
+    {"btree", replay<BTree>},
+    {"be_tree", replay<BeTree<>>},
+    {"lsm", replay<LsmTree<>>},
+    {"splay", replay<SplayTree<>>},
+    {"semi_splay", replay<SplayTree<true>>},
+    {"sharded_btree", replay<ShardedOrderedSet<BTree>>},
+    {"filtered_btree", replay<FilteredOrderedSet<BTree>>},
+    {"compressed_btree", replay<CompressedBTree<>>},
+    {"roaring", replay<RoaringSet>},
+};
+
+static uint32_t percentile(const std::vector<uint32_t>& sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+static void report(const std::string& name, const Trace& trace, Result& result, const Answers& expected) {
+    size_t mismatches = 0;
+    std::optional<size_t> first;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        if (result.answers[i] != expected[i]) {
+            ++mismatches;
+            if (!first.has_value()) first = i;
+        }
+    }
+
+    std::printf("%s: %.3f Mops/s", name.c_str(), trace.size() / result.seconds / 1e6);
+    if (first.has_value()) {
+        std::printf(", %zu MISMATCHES, first at op %zu (%s %lu)\n", mismatches, *first,
+            op_name(trace.ops[*first]), static_cast<unsigned long>(trace.keys[*first]));
+    } else {
+        std::printf(", answers match\n");
+    }
+
+    for (size_t op = 0; op < OPS; ++op) {
+        auto& latencies = result.latencies[op];
+        if (latencies.empty()) continue;
+        std::sort(latencies.begin(), latencies.end());
+
+        double total = 0;
+        for (const auto latency : latencies) {
+            total += latency;
+        }
+        std::printf("  %-12s %10zu ops  mean %7.0f ns  p50 %6u  p99 %6u  p99.9 %7u  max %8u\n",
+            op_name(static_cast<Op>(op)), latencies.size(), total / latencies.size(),
+            percentile(latencies, 0.5), percentile(latencies, 0.99),
+            percentile(latencies, 0.999), latencies.back());
+    }
+}
+
+static Trace generate(size_t count, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    // Each key sees about 1.2 inserts and removes, two of three of them
+    // inserts.
+    std::uniform_int_distribution<key_type> key(0, count / 4);
+    std::discrete_distribution<int> op{20, 10, 40, 15, 15};
+
+    Trace trace;
+    for (size_t i = 0; i < count; ++i) {
+        trace.push_back(static_cast<Op>(op(rng)), key(rng));
+    }
+    return trace;
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 4 && std::string(argv[1]) == "--generate") {
+        auto trace = generate(std::stoull(argv[3]), argc > 4 ? std::stoul(argv[4]) : 0);
+        std::ofstream out(argv[2], std::ios::binary);
+        if (!write_trace(out, trace)) {
+            std::fprintf(stderr, "cannot write %s\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <trace> [implementation...]\n", argv[0]);
+        std::fprintf(stderr, "       %s --generate <trace> <count> [seed]\n", argv[0]);
+        return 2;
+    }
+
+    std::ifstream in(argv[1], std::ios::binary);
+    auto trace = read_trace(in);
+    if (!trace.has_value()) {
+        std::fprintf(stderr, "cannot read trace %s\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<std::string> names(argv + 2, argv + argc);
+    for (const auto& name : names) {
+        auto known = std::any_of(IMPLEMENTATIONS.begin(), IMPLEMENTATIONS.end(),
+            [&](const auto& implementation) { return implementation.first == name; });
+        if (!known) {
+            std::fprintf(stderr, "unknown implementation %s\n", name.c_str());
+            return 2;
+        }
+    }
+
+    std::printf("%zu operations\n", trace->size());
+    auto expected = replay<StlOrderedSet>(*trace);
+    report("stl", *trace, expected, expected.answers);
+
+    bool ok = true;
+    for (const auto& [name, run] : IMPLEMENTATIONS) {
+        if (name == "stl") continue;
+        if (!names.empty() && std::find(names.begin(), names.end(), name) == names.end()) continue;
+
+        auto result = run(*trace);
+        report(name, *trace, result, expected.answers);
+        ok &= result.answers == expected.answers;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <utility>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "b_tree.hpp"
+#include "sorted_keys.hpp"
+
+// An ordered set for the many sets that stay small. Up to INLINE keys live
+// in the object itself, a few more in a sorted array on the heap that
+// doubles up to Threshold keys, and beyond that the set moves into an
+// OrderedSet. The array shrinks as keys are removed, and a tree that falls
+// to a quarter of the threshold moves back into an array, so a set that
+// grows once and empties does not keep paying for it.
+//
+// Arrays are searched by counting the keys less than the target, which
+// takes no branches and runs four keys at a time on AVX2. The object is 24
+// bytes, with no allocation at all while it holds INLINE keys or fewer.
+template <class OrderedSet = BTree, size_t Threshold = 64>
+class AdaptiveOrderedSet {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr size_type INLINE = 2;
+    static constexpr size_type MIN_CAPACITY = 4;
+
+    static_assert(std::has_single_bit(Threshold) && Threshold >= MIN_CAPACITY, "arrays double up to the threshold");
+
+    enum class Representation {
+        Inline,
+        Array,
+        Tree
+    };
+
+private:
+    static constexpr uint32_t TREE = std::numeric_limits<uint32_t>::max();
+
+    // The keys in the array, and its capacity: zero while the keys are
+    // inline, and TREE once they are in m_set.
+    uint32_t m_size;
+    uint32_t m_capacity;
+    union {
+        std::array<key_type, INLINE> m_inline;
+        key_type* m_keys;
+        OrderedSet* m_set;
+    };
+
+    bool is_tree() const {
+        return m_capacity == TREE;
+    }
+
+    const key_type* keys() const {
+        return m_capacity == 0 ? m_inline.data() : m_keys;
+    }
+
+    key_type* keys() {
+        return m_capacity == 0 ? m_inline.data() : m_keys;
+    }
+
+    // The number of keys in the array less than x.
+    size_type rank(key_type x) const {
+        const auto data = keys();
+        size_type less = 0;
+        size_type i = 0;
+#ifdef __AVX2__
+        // AVX2 only compares signed quadwords, so both sides are biased.
+        const auto bias = _mm256_set1_epi64x(std::numeric_limits<int64_t>::min());
+        const auto target = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<int64_t>(x)), bias);
+        for (; i + 4 <= m_size; i += 4) {
+            auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            auto mask = _mm256_cmpgt_epi64(target, _mm256_xor_si256(block, bias));
+            less += std::popcount(static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(mask))));
+        }
+#endif
+        for (; i < m_size; ++i) {
+            less += data[i] < x;
+        }
+        return less;
+    }
+
+    // Moves the keys into the given storage: inline for a capacity of zero,
+    // or a new array.
+    void reallocate(uint32_t capacity) {
+        auto keys = capacity == 0 ? nullptr : new key_type[capacity];
+        auto target = capacity == 0 ? m_inline.data() : keys;
+        auto source = this->keys();
+        auto old = m_capacity == 0 ? nullptr : m_keys;
+        std::memmove(target, source, m_size * sizeof(key_type));
+        delete[] old;
+        if (capacity != 0) m_keys = keys;
+        m_capacity = capacity;
+    }
+
+    void promote() {
+        auto set = new OrderedSet();
+        for (size_type i = 0; i < m_size; ++i) {
+            set->insert(m_keys[i]);
+        }
+        delete[] m_keys;
+        m_set = set;
+        m_size = 0;
+        m_capacity = TREE;
+    }
+
+    void demote() {
+        const auto keys = sorted_keys(*m_set);
+        const auto capacity = std::max<size_type>(std::bit_ceil(keys.size()), MIN_CAPACITY);
+        delete m_set;
+        m_keys = new key_type[capacity];
+        std::copy(keys.begin(), keys.end(), m_keys);
+        m_size = keys.size();
+        m_capacity = capacity;
+        if (m_size <= INLINE / 2) reallocate(0);
+    }
+
+    void release() {
+        if (is_tree()) {
+            delete m_set;
+        } else if (m_capacity != 0) {
+            delete[] m_keys;
+        }
+        m_size = 0;
+        m_capacity = 0;
+    }
+
+public:
+    AdaptiveOrderedSet() : m_size(0), m_capacity(0), m_inline{} {}
+
+    AdaptiveOrderedSet(const AdaptiveOrderedSet&) = delete;
+    AdaptiveOrderedSet& operator=(const AdaptiveOrderedSet&) = delete;
+
+    AdaptiveOrderedSet(AdaptiveOrderedSet&& other) noexcept : AdaptiveOrderedSet() {
+        swap(other);
+    }
+
+    AdaptiveOrderedSet& operator=(AdaptiveOrderedSet&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~AdaptiveOrderedSet() {
+        release();
+    }
+
+    // The inline keys are the largest member, so swapping them swaps
+    // whichever member is in use.
+    void swap(AdaptiveOrderedSet& other) noexcept {
+        std::swap(m_size, other.m_size);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_inline, other.m_inline);
+    }
+
+    friend void swap(AdaptiveOrderedSet& a, AdaptiveOrderedSet& b) noexcept {
+        a.swap(b);
+    }
+
+    bool contains(key_type key) const {
+        if (is_tree()) return m_set->contains(key);
+        const auto i = rank(key);
+        return i < m_size && keys()[i] == key;
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        if (is_tree()) return m_set->predecessor(key);
+        const auto i = rank(key);
+        if (i == 0) return std::nullopt;
+        return keys()[i-1];
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        if (is_tree()) return m_set->successor(key);
+        auto i = rank(key);
+        if (i < m_size && keys()[i] == key) ++i;
+        if (i == m_size) return std::nullopt;
+        return keys()[i];
+    }
+
+    size_type size() const {
+        return is_tree() ? m_set->size() : m_size;
+    }
+
+    void insert(key_type key) {
+        if (is_tree()) {
+            m_set->insert(key);
+            return;
+        }
+
+        const auto i = rank(key);
+        if (i < m_size && keys()[i] == key) return;
+        if (m_size == std::max<size_type>(m_capacity, INLINE)) {
+            if (m_capacity == Threshold) {
+                promote();
+                m_set->insert(key);
+                return;
+            }
+            reallocate(std::max<size_type>(2 * m_capacity, MIN_CAPACITY));
+        }
+
+        auto data = keys();
+        std::memmove(data + i + 1, data + i, (m_size - i) * sizeof(key_type));
+        data[i] = key;
+        ++m_size;
+    }
+
+    void remove(key_type key) {
+        if (is_tree()) {
+            m_set->remove(key);
+            if (m_set->size() <= Threshold / 4) demote();
+            return;
+        }
+
+        const auto i = rank(key);
+        if (i == m_size || keys()[i] != key) return;
+        auto data = keys();
+        std::memmove(data + i, data + i + 1, (m_size - i - 1) * sizeof(key_type));
+        --m_size;
+
+        if (m_capacity != 0 && m_size <= INLINE / 2) {
+            reallocate(0);
+        } else if (m_capacity > MIN_CAPACITY && m_size <= m_capacity / 4) {
+            reallocate(m_capacity / 2);
+        }
+    }
+
+    Representation representation() const {
+        if (is_tree()) return Representation::Tree;
+        return m_capacity == 0 ? Representation::Inline : Representation::Array;
+    }
+
+    // The bytes of the array on the heap, which is all the set allocates
+    // until it becomes a tree.
+    size_type memory() const {
+        return is_tree() || m_capacity == 0 ? 0 : m_capacity * sizeof(key_type);
+    }
+};
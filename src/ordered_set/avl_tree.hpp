@@ -1,6 +1,17 @@
+#pragma once
+
 #include <algorithm>
+#include <array>
 #include <iostream>
 #include <cassert>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "finger.hpp"
+#include "node_pool.hpp"
+#include "parallel.hpp"
 
 class AVLTree {
 
@@ -11,99 +22,87 @@ public:
 private:
     struct Node {
         key_type key;
-        Node* left;
-        Node* right;
+        std::array<Node*, 2> children;
         size_type height;
 
         Node(key_type key) 
-            : key(key), left(nullptr), right(nullptr), height(1) {}
+            : key(key), children{nullptr, nullptr}, height(1) {}
     };
 
     using node_value = Node;
     using node_ptr = node_value*;
 
+    static constexpr size_type LEFT = 0;
+    static constexpr size_type RIGHT = 1;
+
+public:
+    using Finger = ::Finger<Node, key_type, 96>;
+
+private:
+    NodePool<Node> m_pool;
     node_ptr m_root;
     size_type m_size;
 
-    bool contains(node_ptr root, key_type key) const {
-        if (root == nullptr) {
-            return false;
-        }
+    // The smallest and largest keys, while the tree is not empty.
+    key_type m_min;
+    key_type m_max;
 
-        if (key == root->key) {
-            return true;
-        }
+    // Bumped by every update so that stale fingers can be detected.
+    size_type m_version;
 
-        if (key < root->key) {
-            return contains(root->left, key);
-        } else {
-            return contains(root->right, key);
+    // Lookups select the child by index rather than branching on the
+    // comparison, and keep the best node so far with a conditional move, so
+    // the only branch is the loop's own. Each descends to a leaf and checks
+    // the key once, at the end.
+    bool contains(node_ptr root, key_type key) const {
+        node_ptr bound = nullptr;
+        while (root != nullptr) {
+            const bool right = root->key < key;
+            bound = right ? bound : root;
+            root = root->children[right];
         }
+        return bound != nullptr && bound->key == key;
     }
 
+    // The node with the largest key less than the key.
     node_ptr predecessor(node_ptr root, key_type key) const {
-        if (root == nullptr) {
-            return nullptr;
-        }
-
-        // If the key exists and has a left subtree, the predecessor is there.
-        if (key == root->key && root->left != nullptr) {
-            auto pred = root->left;
-            while (pred->right != nullptr) {
-                pred = pred->right;
-            }
-            return pred;
-        }
-
-        // Otherwise, the predecessor is the maximum parent less than the key.
-        if (key <= root->key) {
-            return predecessor(root->left, key);
+        node_ptr pred = nullptr;
+        while (root != nullptr) {
+            const bool right = root->key < key;
+            pred = right ? root : pred;
+            root = root->children[right];
         }
-
-        auto pred = predecessor(root->right, key);
-        return pred == nullptr || root->key > pred->key ? root : pred;
+        return pred;
     }
 
+    // The node with the smallest key greater than the key.
     node_ptr successor(node_ptr root, key_type key) const {
-        if (root == nullptr) {
-            return nullptr;
-        }
-
-        // If the key exists and has a right subtree, the successor is there.
-        if (key == root->key && root->right != nullptr) {
-            auto succ = root->right;
-            while (succ->left != nullptr) {
-                succ = succ->left;
-            }
-            return succ;
-        }
-
-        // Otherwise, the successor is the minimum parent greater than the key.
-        if (key >= root->key) {
-            return successor(root->right, key);
+        node_ptr succ = nullptr;
+        while (root != nullptr) {
+            const bool right = root->key <= key;
+            succ = right ? succ : root;
+            root = root->children[right];
         }
-
-        auto succ = successor(root->left, key);
-        return succ == nullptr || root->key < succ->key ? root : succ;
+        return succ;
     }
 
     node_ptr rotate_right(node_ptr root) {
         assert(root != nullptr);
-        assert(root->left != nullptr);
+        assert(root->children[LEFT] != nullptr);
 
         // Destructure.
-        auto x = root->left;
+        auto x = root->children[LEFT];
         auto y = root;
-        auto a = root->left->left;
-        auto b = root->left->right;
-        auto c = root->right;
+        auto a = root->children[LEFT]->children[LEFT];
+        auto b = root->children[LEFT]->children[RIGHT];
+        auto c = root->children[RIGHT];
 
         // Rotate.
-        y->left = b;
-        y->right = c;
+        y->children[LEFT] = b;
+        y->children[RIGHT] = c;
         y->height = 1 + std::max(height(b), height(c));
-        x->left = a;
-        x->right = y;
+        x->children[LEFT] = a;
+        x->children[RIGHT] = y;
         x->height = 1 + std::max(height(a), height(y));
 
         return x;
@@ -111,27 +110,27 @@ private:
 
     node_ptr rotate_left(node_ptr root) {
         assert(root != nullptr);
-        assert(root->right != nullptr);
+        assert(root->children[RIGHT] != nullptr);
 
         // Destructure.
-        auto x = root->right;
+        auto x = root->children[RIGHT];
         auto y = root;
-        auto a = root->left;
-        auto b = root->right->left;
-        auto c = root->right->right;
+        auto a = root->children[LEFT];
+        auto b = root->children[RIGHT]->children[LEFT];
+        auto c = root->children[RIGHT]->children[RIGHT];
 
         // Rotate.
-        y->left = a;
-        y->right = b;
+        y->children[LEFT] = a;
+        y->children[RIGHT] = b;
         y->height = 1 + std::max(height(a), height(b));
-        x->left = y;
-        x->right = c;
+        x->children[LEFT] = y;
+        x->children[RIGHT] = c;
         x->height = 1 + std::max(height(y), height(c));
 
         return x;
     }
 
-    size_type height(const node_ptr root) const {
+    static size_type height(const node_ptr root) {
         return root != nullptr ? root->height : 0;
     }
 
@@ -139,7 +138,9 @@ private:
         // If the root is empty, insert the key.
         if (root == nullptr) {
             m_size++;
-            return new Node(key);
+            if (m_size == 1 || key < m_min) m_min = key;
+            if (m_size == 1 || key > m_max) m_max = key;
+            return m_pool.create(key);
         }
 
         // Ignore double insertions.
@@ -148,30 +149,32 @@ private:
         }
 
         // Insert into the correct subtree.
-        if (key < root->key) {
-            root->left = insert(root->left, key);
-        } else {
-            root->right = insert(root->right, key);
-        }
+        const bool right = key > root->key;
+        root->children[right] = insert(root->children[right], key);
 
+        return balance(root, key);
+    }
+
+    // Restores the root's height and balance after inserting the key below it.
+    node_ptr balance(node_ptr root, key_type key) {
         // The root's height might be incorrect now. Fix it.
-        root->height = 1 + std::max(height(root->left), height(root->right));
+        root->height = 1 + std::max(height(root->children[LEFT]), height(root->children[RIGHT]));
 
         // If the left subtree is too high, fix it.
-        if (height(root->left) > height(root->right) + 1) {
+        if (height(root->children[LEFT]) > height(root->children[RIGHT]) + 1) {
             // If the left right subtree is too high, make the left left subtree high instead.
-            if (key > root->left->key) {
-                root->left = rotate_left(root->left);
+            if (key > root->children[LEFT]->key) {
+                root->children[LEFT] = rotate_left(root->children[LEFT]);
             }
             // Fix the high left left subtree.
             return rotate_right(root);
         }
 
         // If the right subtree is high, fix it.
-        if (height(root->right) > height(root->left) + 1) {
+        if (height(root->children[RIGHT]) > height(root->children[LEFT]) + 1) {
             // If the right left subtree is too high, make the right right subtree high instead.
-            if (key < root->right->key) {
-                root->right = rotate_right(root->right);
+            if (key < root->children[RIGHT]->key) {
+                root->children[RIGHT] = rotate_right(root->children[RIGHT]);
             }
             // Fix the high right right subtree.
             return rotate_left(root);
@@ -189,48 +192,213 @@ private:
         // Remove the key.
         if (key == root->key) {
             // If there are less than two children, the child is now the root.
-            if (root->left == nullptr || root->right == nullptr) {
+            if (root->children[LEFT] == nullptr || root->children[RIGHT] == nullptr) {
                 m_size--;
-                auto child = root->left != nullptr ? root->left : root->right;
-                delete root;
+                auto child = root->children[LEFT] != nullptr ? root->children[LEFT] : root->children[RIGHT];
+                m_pool.destroy(root);
                 return child;
             }
 
             // Otherwise, swap the successor and the root then remove the successor.
             auto succ = successor(root, root->key);
             std::swap(succ->key, root->key);
-            root->right = remove(root->right, key);
+            root->children[RIGHT] = remove(root->children[RIGHT], key);
         }
-        else if (key < root->key) {
-            root->left = remove(root->left, key);
-        } else {
-            root->right = remove(root->right, key);
+        else {
+            const bool right = key > root->key;
+            root->children[right] = remove(root->children[right], key);
         }
 
+        return rebalance(root);
+    }
+
+    // Restores the root's height and balance after its subtrees changed
+    // height by at most one, or two for a root that was balanced before.
+    node_ptr rebalance(node_ptr root) {
+        // The root's height might be incorrect now. Fix it.
+        root->height = 1 + std::max(height(root->children[LEFT]), height(root->children[RIGHT]));
+
         // If the left subtree is too high, fix it.
-        if (height(root->left) > height(root->right) + 1) {
+        if (height(root->children[LEFT]) > height(root->children[RIGHT]) + 1) {
             // If the left right subtree is too high, make the left left subtree high instead.
-            if (root->left && height(root->left->right) > height(root->left->left) + 1) {
-                root->left = rotate_left(root->left);
+            if (height(root->children[LEFT]->children[RIGHT]) > height(root->children[LEFT]->children[LEFT])) {
+                root->children[LEFT] = rotate_left(root->children[LEFT]);
             }
             // Fix the high left left subtree.
             return rotate_right(root);
         }
 
         // If the right subtree is too high, fix it.
-        if (height(root->right) > height(root->left) + 1) {
+        if (height(root->children[RIGHT]) > height(root->children[LEFT]) + 1) {
             // If the right left subtree is too high, make the right right subtree high instead.
-            if (root->right && height(root->right->left) > height(root->right->right) + 1) {
-                root->right = rotate_right(root->right);
+            if (height(root->children[RIGHT]->children[LEFT]) > height(root->children[RIGHT]->children[RIGHT])) {
+                root->children[RIGHT] = rotate_right(root->children[RIGHT]);
             }
             // Fix the high right right subtree.
             return rotate_left(root);
         }
 
-        assert(std::abs((int)height(root->left) - (int)height(root->right)) <= 1);
+        assert(std::abs((int)height(root->children[LEFT]) - (int)height(root->children[RIGHT])) <= 1);
         return root;
     }
 
+    // Joins two trees and a node whose key lies between theirs into one,
+    // hanging the node off the taller tree at the height of the shorter one.
+    // Takes time in the difference of their heights.
+    node_ptr join(node_ptr left, node_ptr mid, node_ptr right) {
+        if (height(left) > height(right) + 1) {
+            left->children[RIGHT] = join(left->children[RIGHT], mid, right);
+            return rebalance(left);
+        }
+        if (height(right) > height(left) + 1) {
+            right->children[LEFT] = join(left, mid, right->children[LEFT]);
+            return rebalance(right);
+        }
+
+        mid->children = {left, right};
+        mid->height = 1 + std::max(height(left), height(right));
+        return mid;
+    }
+
+    // Splits the tree into the keys less than the key and the rest, in time
+    // logarithmic in its size, by joining the subtrees along the search path.
+    std::pair<node_ptr, node_ptr> split(node_ptr root, key_type key) {
+        if (root == nullptr) {
+            return {nullptr, nullptr};
+        }
+
+        auto left = root->children[LEFT];
+        auto right = root->children[RIGHT];
+        if (root->key < key) {
+            auto [less, rest] = split(right, key);
+            return {join(left, root, less), rest};
+        }
+        auto [less, rest] = split(left, key);
+        return {less, join(rest, root, right)};
+    }
+
+    // The node at the far end of the subtree on the given side.
+    static node_ptr extreme(node_ptr root, size_type side) {
+        while (root->children[side] != nullptr) {
+            root = root->children[side];
+        }
+        return root;
+    }
+
+    void destroy(node_ptr root) {
+        if (root == nullptr) {
+            return;
+        }
+
+        destroy(root->children[LEFT]);
+        destroy(root->children[RIGHT]);
+        m_pool.destroy(root);
+    }
+
+    // Removes the n keys at the far end on the given side and returns them
+    // from the outermost in. They are found by walking the tree in order
+    // from that end and cut off by a single split.
+    std::vector<key_type> pop(size_type n, size_type side) {
+        n = std::min(n, m_size);
+        std::vector<key_type> keys;
+        keys.reserve(n);
+
+        std::vector<node_ptr> stack;
+        auto node = m_root;
+        while (keys.size() < n) {
+            for (; node != nullptr; node = node->children[side]) {
+                stack.push_back(node);
+            }
+            node = stack.back();
+            stack.pop_back();
+            keys.push_back(node->key);
+            node = node->children[1 - side];
+        }
+        if (n == 0) {
+            return keys;
+        }
+
+        ++m_version;
+        m_size -= n;
+        if (m_size == 0) {
+            m_pool = NodePool<Node>(m_pool.pages());
+            m_root = nullptr;
+            return keys;
+        }
+
+        // The smallest keys end below the last one popped, the largest at it.
+        if (side == LEFT) {
+            auto [popped, rest] = split(m_root, keys.back() + 1);
+            destroy(popped);
+            m_root = rest;
+            m_min = extreme(m_root, LEFT)->key;
+        } else {
+            auto [rest, popped] = split(m_root, keys.back());
+            destroy(popped);
+            m_root = rest;
+            m_max = extreme(m_root, RIGHT)->key;
+        }
+        return keys;
+    }
+
+    // Extends the finger from its last entry down to the key's node, or to
+    // the node the key would hang off.
+    void descend(Finger& finger, key_type key) const {
+        auto entry = finger.path[finger.depth-1];
+        while (key != entry.node->key) {
+            auto right = key > entry.node->key;
+            auto child = entry.node->children[right];
+            if (child == nullptr) {
+                break;
+            }
+
+            finger.path[finger.depth-1].index = right;
+            if (right) {
+                entry = {child, 0, entry.node->key, entry.hi, true, entry.has_hi};
+            } else {
+                entry = {child, 0, entry.lo, entry.node->key, entry.has_lo, true};
+            }
+            finger.path[finger.depth++] = entry;
+        }
+    }
+
+    // Builds a perfectly balanced subtree over keys[lo, hi) from the pool.
+    static node_ptr build(const std::vector<key_type>& keys, size_type lo, size_type hi, size_type threads, NodePool<Node>& pool) {
+        if (lo == hi) {
+            return nullptr;
+        }
+
+        auto mid = lo + (hi - lo) / 2;
+        auto root = pool.create(keys[mid]);
+
+        // The subtrees are independent, so build them on separate threads,
+        // the right one from a pool of its own.
+        NodePool<Node> right(pool.pages());
+        parallel_invoke(2, threads, [&](size_type i, size_type budget) {
+            if (i == 0) {
+                root->children[LEFT] = build(keys, lo, mid, budget, pool);
+            } else {
+                root->children[RIGHT] = build(keys, mid + 1, hi, budget, threads > 1 ? right : pool);
+            }
+        });
+        pool.adopt(std::move(right));
+
+        root->height = 1 + std::max(height(root->children[LEFT]), height(root->children[RIGHT]));
+        return root;
+    }
+
+    // Copies the subtree into the pool in depth-first order.
+    static node_ptr clone(const node_ptr root, NodePool<Node>& pool) {
+        if (root == nullptr) {
+            return nullptr;
+        }
+
+        auto copy = pool.create(*root);
+        copy->children[LEFT] = clone(root->children[LEFT], pool);
+        copy->children[RIGHT] = clone(root->children[RIGHT], pool);
+        return copy;
+    }
+
     void print(node_ptr root, size_type depth) {
         if (root == nullptr) {
             for (size_type i = 0; i < depth; ++i) {
@@ -244,18 +412,64 @@ private:
             std::cout << "\t";
         }
         std::cout << root->key << std::endl;
-        print(root->left, depth+1);
-        print(root->right, depth+1);
+        print(root->children[LEFT], depth+1);
+        print(root->children[RIGHT], depth+1);
     }
 
 public:
-    AVLTree() : m_root(nullptr), m_size(0) {}
+    AVLTree() : m_root(nullptr), m_size(0), m_min(0), m_max(0), m_version(0) {}
+
+    // A tree whose nodes are allocated from pages of the given kind.
+    explicit AVLTree(Pages pages) : m_pool(pages), m_root(nullptr), m_size(0), m_min(0), m_max(0), m_version(0) {}
+
+    // Copying is explicit, through clone().
+    AVLTree(const AVLTree&) = delete;
+    AVLTree& operator=(const AVLTree&) = delete;
+
+    // The other tree is left empty, without any memory of its own.
+    AVLTree(AVLTree&& other) noexcept
+        : m_pool(std::move(other.m_pool)), m_root(std::exchange(other.m_root, nullptr)),
+          m_size(std::exchange(other.m_size, 0)), m_min(other.m_min), m_max(other.m_max),
+          m_version(++other.m_version) {}
+
+    AVLTree& operator=(AVLTree&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    // Fingers into either tree go stale, since both versions move past the
+    // versions they were taken at.
+    void swap(AVLTree& other) noexcept {
+        const auto version = std::max(m_version, other.m_version) + 1;
+        m_pool.swap(other.m_pool);
+        std::swap(m_root, other.m_root);
+        std::swap(m_size, other.m_size);
+        std::swap(m_min, other.m_min);
+        std::swap(m_max, other.m_max);
+        m_version = other.m_version = version;
+    }
+
+    friend void swap(AVLTree& a, AVLTree& b) noexcept {
+        a.swap(b);
+    }
+
+    // Copies the tree into a single allocation, with the nodes laid out in
+    // depth-first order.
+    AVLTree clone() const {
+        AVLTree copy(m_pool.pages());
+        copy.m_pool.reserve(m_size);
+        copy.m_root = clone(m_root, copy.m_pool);
+        copy.m_size = m_size;
+        copy.m_min = m_min;
+        copy.m_max = m_max;
+        return copy;
+    }
 
     bool contains(key_type key) const {
         return contains(m_root, key);
     }
 
-    std::optional<key_type> predecessor(key_type key) {
+    std::optional<key_type> predecessor(key_type key) const {
         auto pred = predecessor(m_root, key);
         if (pred == nullptr) {
             return std::nullopt;
@@ -263,7 +477,7 @@ public:
         return std::make_optional(pred->key);
     }
 
-    std::optional<key_type> successor(key_type key) {
+    std::optional<key_type> successor(key_type key) const {
         auto succ = successor(m_root, key);
         if (succ == nullptr) {
             return std::nullopt;
@@ -275,12 +489,104 @@ public:
         return m_size;
     }
 
+    // The smallest key, kept up to date by every update.
+    std::optional<key_type> min() const {
+        if (m_size == 0) {
+            return std::nullopt;
+        }
+        return m_min;
+    }
+
+    std::optional<key_type> max() const {
+        if (m_size == 0) {
+            return std::nullopt;
+        }
+        return m_max;
+    }
+
+    // Removes the n smallest keys, or all of them if there are fewer, and
+    // returns them in increasing order. Takes O(n + log size) time rather
+    // than a removal per key.
+    std::vector<key_type> pop_min(size_type n) {
+        return pop(n, LEFT);
+    }
+
+    // Removes the n largest keys and returns them in decreasing order.
+    std::vector<key_type> pop_max(size_type n) {
+        return pop(n, RIGHT);
+    }
+
     void insert(key_type key) {
         m_root = insert(m_root, key);
+        ++m_version;
+    }
+
+    // Inserts the key starting from the node the finger was left at, and
+    // leaves the finger at the key. Runs of nearby keys, such as increasing or
+    // decreasing sequences, take amortized constant time.
+    void insert(Finger& finger, key_type key) {
+        if (m_root == nullptr) {
+            insert(key);
+            finger.depth = 0;
+        }
+
+        // Start over from the root if the finger is stale.
+        if (finger.owner != this || finger.version != m_version || finger.depth == 0) {
+            finger.owner = this;
+            finger.path[0] = {m_root, 0, 0, 0, false, false};
+            finger.depth = 1;
+            descend(finger, key);
+        }
+
+        // Walk up until the subtree can hold the key.
+        auto top = finger.depth - 1;
+        while (top > 0 && !finger.path[top].holds(key)) --top;
+
+        // Insert the key, then fix heights upwards until nothing changes.
+        auto child = finger.path[top].node;
+        auto height = child->height;
+        auto root = insert(child, key);
+        while (top > 0 && (root != child || root->height != height)) {
+            --top;
+            auto parent = finger.path[top].node;
+            parent->children[finger.path[top].index] = root;
+            child = parent;
+            height = parent->height;
+            root = balance(parent, key);
+        }
+        if (top == 0) {
+            m_root = root;
+        }
+
+        // Everything below the top might have moved, so find the key again.
+        finger.path[top].node = root;
+        finger.depth = top + 1;
+        descend(finger, key);
+        finger.version = ++m_version;
     }
 
     void remove(key_type key) {
         m_root = remove(m_root, key);
+        ++m_version;
+
+        // Only removing an end of the tree needs a walk to the new end.
+        if (m_size > 0 && key == m_min) m_min = extreme(m_root, LEFT)->key;
+        if (m_size > 0 && key == m_max) m_max = extreme(m_root, RIGHT)->key;
+    }
+
+    // Builds the tree from unsorted keys that may contain duplicates, using up
+    // to the given number of threads. The tree must be empty.
+    template <class Iterator>
+    void build_parallel(Iterator first, Iterator last, size_type threads) {
+        assert(m_root == nullptr);
+        const auto keys = parallel_sort_unique(first, last, threads);
+        m_root = build(keys, 0, keys.size(), threads, m_pool);
+        m_size = keys.size();
+        if (!keys.empty()) {
+            m_min = keys.front();
+            m_max = keys.back();
+        }
+        ++m_version;
     }
 
     void print() {
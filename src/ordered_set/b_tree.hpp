@@ -1,12 +1,27 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <array>
 #include <cassert>
 #include <cstddef>
+#include <iterator>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "finger.hpp"
+#include "node_pool.hpp"
+#include "parallel.hpp"
 
 #define B 4
 
+// Define BTREE_SUMS to 1 to also keep per-child key sums for sum_range().
+#ifndef BTREE_SUMS
+#define BTREE_SUMS 0
+#endif
+
 // invariants: besides root, the numbers of keys in node
 // is between B/2 - 1 and B-1
 
@@ -16,6 +31,13 @@ public:
     using size_type = size_t;
     using key_type = uint64_t;
 
+    // Batches smaller than this are applied one key at a time.
+    static constexpr size_type PARALLEL_BATCH = 1 << 12;
+
+    // Batches are split into about this many subtrees per thread, so that
+    // threads that finish early can take over more of them.
+    static constexpr size_type TASKS_PER_THREAD = 8;
+
 private:
 
     struct Node {
@@ -23,6 +45,13 @@ private:
         std::array<key_type, B> keys;
         size_type size;
 
+        // The number of keys in the subtree under each child.
+        std::array<size_type, B+1> counts;
+#if BTREE_SUMS
+        // The sum of the keys in the subtree under each child, modulo 2^64.
+        std::array<key_type, B+1> sums;
+#endif
+
         Node() {
             for (size_type i = 0; i < B; ++i) {
                 keys.at(i) = 0;
@@ -30,306 +59,1196 @@ private:
 
             for (size_type i = 0; i < B + 1; ++i) {
                 children.at(i) = nullptr;
+                counts.at(i) = 0;
+#if BTREE_SUMS
+                sums.at(i) = 0;
+#endif
             }
 
             size = 0;
         }
     };
 
+public:
+    using Finger = ::Finger<Node, key_type, 64>;
+
+private:
+    NodePool<Node> m_pool;
     Node* m_root;
     size_type m_size;
 
+    // The smallest and largest keys, while the tree is not empty.
+    key_type m_min;
+    key_type m_max;
+
+    // Bumped by every update so that stale fingers can be detected.
+    size_type m_version;
+
 private:
 
-    bool split(Node* root, size_type i) {
-        auto child = root->children.at(i);
-        assert(child->size == B);
+    // The number of keys in the subtree.
+    static size_type count(const Node* root) {
+        if (root == nullptr) return 0;
+        size_type count = root->size;
+        for (size_type j = 0; j <= root->size; ++j) {
+            count += root->counts.at(j);
+        }
+        return count;
+    }
 
-        auto m = B / 2;
-        auto median = child->keys.at(m);
+#if BTREE_SUMS
+    // The sum of the keys in the subtree.
+    static key_type sum(const Node* root) {
+        if (root == nullptr) return 0;
+        key_type sum = 0;
+        for (size_type j = 0; j < root->size; ++j) {
+            sum += root->keys.at(j);
+        }
+        for (size_type j = 0; j <= root->size; ++j) {
+            sum += root->sums.at(j);
+        }
+        return sum;
+    }
+#endif
 
-        // Create the left node.
-        auto left = new Node();
-        for (size_type j = 0; j < m; ++j) {
-            left->keys.at(j) = child->keys.at(j);
-            left->children.at(j) = child->children.at(j);
+    // Recomputes the aggregates of every child from the children themselves.
+    // Only needed after keys or children moved between nodes.
+    static void refresh(Node* root) {
+        for (size_type j = 0; j < B + 1; ++j) {
+            root->counts.at(j) = count(root->children.at(j));
+#if BTREE_SUMS
+            root->sums.at(j) = sum(root->children.at(j));
+#endif
         }
-        left->children.at(m) = child->children.at(m);
-        left->size = m;
+    }
+
+    // Accounts for a key added to or removed from the subtree under child i.
+    static void account(Node* root, size_type i, [[maybe_unused]] key_type key, bool added) {
+        if (added) {
+            ++(root->counts.at(i));
+        } else {
+            --(root->counts.at(i));
+        }
+#if BTREE_SUMS
+        if (added) {
+            root->sums.at(i) += key;
+        } else {
+            root->sums.at(i) -= key;
+        }
+#endif
+    }
+
+    // Splits the full child i around its median. The child keeps the lower
+    // half, the upper half moves to a new right sibling and the median moves
+    // up into the root.
+    void split(Node* root, size_type i) {
+        auto left = root->children.at(i);
+        assert(left->size == B-1);
+        assert(root->size < B-1);
 
-        // Create the right node.
-        auto right = new Node();
-        for (size_type j = m+1; j < B; ++j) {
-            right->keys.at(j-(m+1)) = child->keys.at(j);
-            right->children.at(j-(m+1)) = child->children.at(j);
+        auto m = left->size / 2;
+        auto median = left->keys.at(m);
+
+        // Move the upper half to the right node.
+        auto right = m_pool.create();
+        for (size_type j = m+1; j < left->size; ++j) {
+            right->keys.at(j-(m+1)) = left->keys.at(j);
+            right->children.at(j-(m+1)) = left->children.at(j);
         }
-        right->children.at(B-(m+1)) = child->children.at(B);
-        right->size = m-1;
+        right->children.at(left->size-(m+1)) = left->children.at(left->size);
+        right->size = left->size-(m+1);
 
-        // Create a gap for the median
-        root->children.at(root->size+1) = root->children.at(root->size);
-        for (int j = root->size-1; j >= (int)i; --j) {
-            root->keys.at(j+1) = root->keys.at(j);
+        // Clear it from the left node.
+        for (size_type j = m; j < left->size; ++j) {
+            left->keys.at(j) = 0;
+            left->children.at(j+1) = nullptr;
+        }
+        left->size = m;
+
+        // Create a gap for the median.
+        for (size_type j = root->size; j > i; --j) {
+            root->keys.at(j) = root->keys.at(j-1);
             root->children.at(j+1) = root->children.at(j);
         }
 
         // And insert the median.
         root->keys.at(i) = median;
-        root->children.at(i) = left;
         root->children.at(i+1) = right;
         ++(root->size);
-        return root->size == B;
+
+        refresh(left);
+        refresh(right);
+        refresh(root);
     }
 
-    bool insert(Node* root, key_type key) {
-        // If the node is a leaf, insert the key in sorted order.
-        if (root->children.at(0) == nullptr) {
-            // Find where the key will be inserted.
+    // Rotates the last key of child i-1 through the root into child i.
+    void borrow_left(Node* root, size_type i) {
+        auto child = root->children.at(i);
+        auto left = root->children.at(i-1);
+
+        // Shift over.
+        child->children.at(child->size+1) = child->children.at(child->size);
+        for (size_type j = child->size; j > 0; --j) {
+            child->keys.at(j) = child->keys.at(j-1);
+            child->children.at(j) = child->children.at(j-1);
+        }
+
+        // Move down.
+        child->keys.at(0) = root->keys.at(i-1);
+        child->children.at(0) = left->children.at(left->size);
+        ++(child->size);
+
+        // Move up.
+        root->keys.at(i-1) = left->keys.at(left->size-1);
+        left->keys.at(left->size-1) = 0;
+        left->children.at(left->size) = nullptr;
+        --(left->size);
+
+        refresh(child);
+        refresh(left);
+        refresh(root);
+    }
+
+    // Rotates the first key of child i+1 through the root into child i.
+    void borrow_right(Node* root, size_type i) {
+        auto child = root->children.at(i);
+        auto right = root->children.at(i+1);
+
+        // Move down.
+        child->keys.at(child->size) = root->keys.at(i);
+        child->children.at(child->size+1) = right->children.at(0);
+        ++(child->size);
+
+        // Move up.
+        root->keys.at(i) = right->keys.at(0);
+
+        // Shift over.
+        for (size_type j = 0; j + 1 < right->size; ++j) {
+            right->keys.at(j) = right->keys.at(j+1);
+            right->children.at(j) = right->children.at(j+1);
+        }
+        right->children.at(right->size-1) = right->children.at(right->size);
+        right->keys.at(right->size-1) = 0;
+        right->children.at(right->size) = nullptr;
+        --(right->size);
+
+        refresh(child);
+        refresh(right);
+        refresh(root);
+    }
+
+    // Merges child i+1 and the key between them into child i in place.
+    void merge(Node* root, size_type i) {
+        auto left = root->children.at(i);
+        auto right = root->children.at(i+1);
+        assert(left->size + right->size < B-1);
+
+        // Move the key between them and the right node into the left node.
+        left->keys.at(left->size) = root->keys.at(i);
+        for (size_type j = 0; j < right->size; ++j) {
+            left->keys.at(left->size+1+j) = right->keys.at(j);
+            left->children.at(left->size+1+j) = right->children.at(j);
+        }
+        left->children.at(left->size+1+right->size) = right->children.at(right->size);
+        left->size += 1 + right->size;
+        m_pool.destroy(right);
+
+        // Close the gap in the root.
+        for (size_type j = i; j + 1 < root->size; ++j) {
+            root->keys.at(j) = root->keys.at(j+1);
+            root->children.at(j+1) = root->children.at(j+2);
+        }
+        root->keys.at(root->size-1) = 0;
+        root->children.at(root->size) = nullptr;
+        --(root->size);
+
+        refresh(left);
+        refresh(root);
+    }
+
+    // Makes sure child i can lose a key before descending into it, by
+    // borrowing from a sibling or merging with one. Returns the child to
+    // descend into, which moves left if it was merged into its left sibling.
+    size_type refill(Node* root, size_type i) {
+        if (root->children.at(i)->size > (B/2 - 1)) {
+            return i;
+        }
+
+        if (i > 0 && root->children.at(i-1)->size > (B/2 - 1)) {
+            borrow_left(root, i);
+            return i;
+        }
+
+        if (i < root->size && root->children.at(i+1)->size > (B/2 - 1)) {
+            borrow_right(root, i);
+            return i;
+        }
+
+        if (i == root->size) --i;
+        merge(root, i);
+        return i;
+    }
+
+    // If merging emptied the root, its only child becomes the root.
+    Node* shrink() {
+        if (m_root->size == 0 && m_root->children.at(0) != nullptr) {
+            auto old_root = m_root;
+            m_root = m_root->children.at(0);
+            m_pool.destroy(old_root);
+        }
+        return m_root;
+    }
+
+    // Inserts the key into the subtree at the finger's top entry in a single
+    // pass, splitting full children before descending into them so that a
+    // split never has to travel back up. The top node must not be full.
+    // Leaves the finger at the key and returns if the key was inserted.
+    bool insert(Finger& finger, size_type top, key_type key) {
+        finger.depth = top + 1;
+        while (true) {
+            auto& entry = finger.path[finger.depth-1];
+            auto node = entry.node;
+
             size_type i = 0;
-            while (i < root->size && root->keys.at(i) < key) ++i;
+            while (i < node->size && node->keys.at(i) < key) ++i;
 
             // If the key already exists, do not insert it.
-            if (i < root->size && root->keys.at(i) == key) {
+            if (i < node->size && node->keys.at(i) == key) {
                 return false;
             }
 
-            // Otherwise, create a gap for the new key.
-            for (int j = root->size - 1; j >= (int)i; --j) {
-                root->keys.at(j+1) = root->keys.at(j);
+            // If the node is a leaf, insert the key in sorted order.
+            if (node->children.at(0) == nullptr) {
+                for (size_type j = node->size; j > i; --j) {
+                    node->keys.at(j) = node->keys.at(j-1);
+                }
+                node->keys.at(i) = key;
+                ++(node->size);
+                ++m_size;
+                if (m_size == 1 || key < m_min) m_min = key;
+                if (m_size == 1 || key > m_max) m_max = key;
+                return true;
             }
 
-            // And insert the new key.
-            root->keys.at(i) = key;
-            ++(root->size);
-            ++m_size;
+            // Otherwise, make room in the child before descending into it.
+            if (node->children.at(i)->size == B-1) {
+                split(node, i);
+                if (node->keys.at(i) == key) {
+                    return false;
+                }
+                if (node->keys.at(i) < key) {
+                    ++i;
+                }
+            }
 
-            // Return if the node is full.
-            return root->size == B;
+            entry.index = i;
+            finger.path[finger.depth++] = {
+                node->children.at(i), 0,
+                i > 0 ? node->keys.at(i-1) : entry.lo,
+                i < node->size ? node->keys.at(i) : entry.hi,
+                i > 0 || entry.has_lo,
+                i < node->size || entry.has_hi
+            };
+        }
+    }
+
+    // Accounts for the key inserted at the end of the finger's path.
+    static void account(const Finger& finger, key_type key) {
+        for (size_type l = 0; l + 1 < finger.depth; ++l) {
+            account(finger.path[l].node, finger.path[l].index, key, true);
+        }
+    }
+
+    bool contains(Node* root, key_type key) const {
+        if (root == nullptr) {
+            return false;
         }
 
-        // Otherwise, find the child to recurse on.
         size_type i = 0;
         while (i < root->size && root->keys.at(i) < key) ++i;
-        
-        // If the key already exists, stop inserting.
         if (i < root->size && root->keys.at(i) == key) {
-            return false;
+            return true;
         }
 
-        // Otherwise, insert the key and split if required.
-        bool full = insert(root->children.at(i), key);
-        if (!full) return false;
-        return split(root, i);
+        return contains(root->children.at(i), key);
     }
 
-    bool remove(Node* root, key_type key) {
-        // Otherwise, find the child to recurse on.
+    std::optional<key_type> predecessor(Node* root, key_type key) const {
+        if (root == nullptr) {
+            return std::nullopt;
+        }
+
+        // Everything in the child is greater than the key to its left.
         size_type i = 0;
         while (i < root->size && root->keys.at(i) < key) ++i;
-        
-        // If the key already exists.
-        if (i < root->size && root->keys.at(i) == key) {
-            // Remove it if it's in a leaf.
-            if (root->children[0] == nullptr) {
-                for (size_type j = i; j < root->size; ++j) {
-                    root->keys[j] = root->keys[j+1];
-                }
-                root->keys[root->size-1] = 0;
-                --(root->size);
-                --m_size;
-                return root->size < (B/2 - 1);
+        auto pred = predecessor(root->children.at(i), key);
+        if (pred.has_value() || i == 0) {
+            return pred;
+        }
+        return root->keys.at(i-1);
+    }
+
+    std::optional<key_type> successor(Node* root, key_type key) const {
+        if (root == nullptr) {
+            return std::nullopt;
+        }
+
+        // Everything in the child is less than the key to its right.
+        size_type i = 0;
+        while (i < root->size && root->keys.at(i) <= key) ++i;
+        auto succ = successor(root->children.at(i), key);
+        if (succ.has_value() || i == root->size) {
+            return succ;
+        }
+        return root->keys.at(i);
+    }
+
+    // The number of keys less than the key.
+    size_type rank(Node* root, key_type key) const {
+        size_type rank = 0;
+        while (root != nullptr) {
+            size_type i = 0;
+            while (i < root->size && root->keys.at(i) < key) {
+                rank += root->counts.at(i) + 1;
+                ++i;
             }
+            if (i < root->size && root->keys.at(i) == key) {
+                return rank + root->counts.at(i);
+            }
+            root = root->children.at(i);
+        }
+        return rank;
+    }
 
-            // Otherwise, swap with its succ.
-            auto node = root->children[i+1];
-            while (node->children[0] != nullptr) {
-                node = node->children[0];
+#if BTREE_SUMS
+    // The sum of the keys less than the key.
+    key_type prefix_sum(Node* root, key_type key) const {
+        key_type sum = 0;
+        while (root != nullptr) {
+            size_type i = 0;
+            while (i < root->size && root->keys.at(i) < key) {
+                sum += root->sums.at(i) + root->keys.at(i);
+                ++i;
             }
-            std::swap(node->keys[0], key);
-        } else {
-            // The key does not exist.
-            if (root->children[0] == nullptr) {
-                return false;
+            if (i < root->size && root->keys.at(i) == key) {
+                return sum + root->sums.at(i);
             }
-            
+            root = root->children.at(i);
         }
-        // search and recurse
-        bool empty = remove(root->children[i], key);
-        if (!empty) return false;
+        return sum;
+    }
+#endif
 
-        // if can take from sibling nodes to fill, do it.
-        if (i > 0 && root->children[i-1]->size > (B/2 - 1)) {
-            std::cout << "left" << std::endl;
-            // Shift over.
-            root->children[i]->children[root->children[i]->size+1] = root->children[i]->children[root->children[i]->size];
-            for (size_type j = root->children[i]->size; j > 0; --j) {
-                root->children[i]->keys[j] = root->children[i]->keys[j-1];
-                root->children[i]->children[j] = root->children[i]->children[j-1];
+    // The most keys a subtree of the given height can hold.
+    static size_type capacity(size_type height) {
+        size_type capacity = 1;
+        for (size_type i = 0; i < height; ++i) {
+            capacity *= B;
+        }
+        return capacity - 1;
+    }
+
+    // Builds a subtree of the given height over keys[lo, hi). The node gets
+    // as few children as can hold the keys and the keys are spread evenly
+    // between them, which keeps every child above the minimum size.
+    static Node* build(const std::vector<key_type>& keys, size_type lo, size_type hi, size_type height, size_type threads, NodePool<Node>& pool) {
+        auto root = pool.create();
+        auto count = hi - lo;
+
+        // If the node is a leaf, copy the keys in.
+        if (height == 1) {
+            assert(count < B);
+            for (size_type j = 0; j < count; ++j) {
+                root->keys.at(j) = keys[lo+j];
             }
+            root->size = count;
+            return root;
+        }
 
-            // Move down.
-            root->children[i]->keys[0] = root->keys[i];
-            ++(root->children[i]->size);
+        // Otherwise, split the keys between the children and separators.
+        auto child_capacity = capacity(height-1);
+        size_type children = (count + 1 + child_capacity) / (child_capacity + 1);
+        assert(children >= 2 && children <= B);
 
-            // Move up.
-            root->keys[i] = root->children[i-1]->keys[root->children[i-1]->size-1];
-            root->children[i-1]->keys[root->children[i-1]->size-1] = 0;
-            --(root->children[i-1]->size);
+        auto child_keys = count - (children - 1);
+        std::array<size_type, B+1> begin;
+        std::array<size_type, B+1> end;
+        auto next = lo;
+        for (size_type j = 0; j < children; ++j) {
+            begin.at(j) = next;
+            next += child_keys / children + (j < child_keys % children);
+            end.at(j) = next;
+            if (j + 1 < children) {
+                root->keys.at(j) = keys[next];
+                ++next;
+            }
+        }
+        root->size = children - 1;
 
-            return false;
+        // The children are independent, so build them on separate threads,
+        // each from a pool of its own.
+        std::array<NodePool<Node>, B+1> pools;
+        for (auto& child : pools) {
+            child = NodePool<Node>(pool.pages());
+        }
+        parallel_invoke(children, threads, [&](size_type j, size_type budget) {
+            root->children.at(j) = build(keys, begin.at(j), end.at(j), height-1, budget, threads > 1 ? pools.at(j) : pool);
+        });
+        for (auto& child : pools) {
+            pool.adopt(std::move(child));
+        }
+        refresh(root);
 
-        } else if (i < root->size && root->children[i+1]->size > (B/2 - 1)) {
-            std::cout << "right " << root->children[i+1]->size << std::endl;
-            // Move down.
-            root->children[i]->keys[root->children[i]->size] = root->keys[i];
-            ++(root->children[i]->size);
+        return root;
+    }
+
+    // Copies the subtree into the pool in depth-first order.
+    static Node* clone(const Node* root, NodePool<Node>& pool) {
+        if (root == nullptr) {
+            return nullptr;
+        }
+
+        auto copy = pool.create(*root);
+        for (size_type j = 0; j <= root->size; ++j) {
+            copy->children.at(j) = clone(root->children.at(j), pool);
+        }
+        return copy;
+    }
+
+    // The number of nodes in the subtree.
+    static size_type nodes(const Node* root) {
+        if (root == nullptr) {
+            return 0;
+        }
 
-            // Move up.
-            root->keys[i] = root->children[i+1]->keys[0];
+        size_type count = 1;
+        for (size_type j = 0; j <= root->size; ++j) {
+            count += nodes(root->children.at(j));
+        }
+        return count;
+    }
+
+    // A tree without even an empty root, to be filled in by the caller.
+    BTree(std::nullptr_t, Pages pages) : m_pool(pages), m_root(nullptr), m_size(0), m_min(0), m_max(0), m_version(0) {}
+
+    // The root, which an empty tree only gets on its first insert, so that
+    // empty and moved-from trees own no memory.
+    Node* root() {
+        if (m_root == nullptr) {
+            m_root = m_pool.create();
+        }
+        return m_root;
+    }
+
+    // Splits the full root under a new root.
+    void grow() {
+        auto new_root = m_pool.create();
+        new_root->children.at(0) = m_root;
+        m_root = new_root;
+        split(m_root, 0);
+    }
 
-            // Shift over.
-            for (size_type j = 1; j < root->children[i+1]->size; ++j) {
-                root->children[i+1]->keys[j-1] = root->children[i+1]->keys[j];
-                root->children[i+1]->children[j-1] = root->children[i+1]->children[j];
+    // Extends the finger from its last entry down to the key's node, or to
+    // the leaf the key would be inserted into.
+    void descend(Finger& finger, key_type key) const {
+        auto entry = finger.path[finger.depth-1];
+        while (true) {
+            auto node = entry.node;
+            size_type i = 0;
+            while (i < node->size && node->keys.at(i) < key) ++i;
+            if (node->children.at(0) == nullptr || (i < node->size && node->keys.at(i) == key)) {
+                break;
             }
-            root->children[i+1]->children[root->children[i+1]->size-1] = root->children[i+1]->children[root->children[i+1]->size];
-            root->children[i+1]->keys[root->children[i+1]->size-1] = 0;
-            root->children[i+1]->children[root->children[i+1]->size] = nullptr;
-            --(root->children[i+1]->size);
 
-            return false;
+            finger.path[finger.depth-1].index = i;
+            entry = {
+                node->children.at(i), 0,
+                i > 0 ? node->keys.at(i-1) : entry.lo,
+                i < node->size ? node->keys.at(i) : entry.hi,
+                i > 0 || entry.has_lo,
+                i < node->size || entry.has_hi
+            };
+            finger.path[finger.depth++] = entry;
         }
+    }
 
-        std::cout << "merge" << std::endl;
-        // if cant take from siblings to fill, merge them (i) and (i+1) unless i is max in which case its i-1
-        size_type l, r;
-        if (i == root->size) {
-            l = i-1;
-            r = i;
-        } else {
-            l = i;
-            r = i+1;
-        }
-
-        // build merged node
-        auto merged = new Node();
-        for (size_type j = 0; j < root->children[l]->size; ++j) {
-            merged->keys[j] = root->children[l]->keys[j];
-            merged->children[j] = root->children[l]->children[j];
-        }
-        merged->keys[root->children[l]->size] = root->keys[l];
-        merged->children[root->children[l]->size] = root->children[l]->children[root->children[l]->size];
-        merged->size = root->children[l]->size+1;
-
-        for(size_type j = 0; j < root->children[r]->size; ++j) {
-            merged->keys[j+merged->size] = root->children[r]->keys[j];
-            merged->children[j+merged->size] = root->children[r]->children[j];
-        }
-        merged->children[root->children[r]->size + merged->size] = root->children[r]->children[root->children[r]->size];
-        merged->size += root->children[r]->size;
-        
-        // free memory
-        delete root->children[i];
-        delete root->children[i+1];
-
-        // insert merged node into parent
-        for (size_type j = i; j < root->size; ++j) {
-            root->keys[j] = root->keys[j+1];
-            root->children[j] = root->children[j+1];
-        }
-        root->children[root->size-1] = root->children[root->size];
-        root->keys[root->size-1] = 0;
-        root->children[root->size] = nullptr;
-        --(root->size);
+    // The number of levels in the subtree.
+    static size_type height(const Node* root) {
+        size_type height = 0;
+        for (; root != nullptr; root = root->children.at(0)) {
+            ++height;
+        }
+        return height;
+    }
 
-        // link in the merged node
-        // TODO: instead of this, copy merged into the current root here.
-        if (root->size == 0 && root == m_root) {
-            m_root = merged;
-            return false;
+    // Appends the keys of the subtree in order, or in reverse order.
+    template <bool Reverse = false>
+    static void collect(const Node* root, std::vector<key_type>& keys) {
+        if (root == nullptr) return;
+        for (size_type j = 0; j < root->size; ++j) {
+            const auto i = Reverse ? root->size - j : j;
+            collect<Reverse>(root->children.at(i), keys);
+            keys.push_back(root->keys.at(Reverse ? i - 1 : i));
         }
-        // if (root->size == 0) {
-        //     root->size = merged->size;
-        //     root->children = merged->children;
-        //     root->keys = merged->keys;
-        //     delete merged;
-        //     return false;
-        // }
+        collect<Reverse>(root->children.at(Reverse ? 0 : root->size), keys);
+    }
 
-        root->children[i] = merged;
-        print(m_root, 0);
-        std::cout << "end merge" << std::endl;
-        return root->size < (B/2 - 1);
+    void destroy(Node* root) {
+        if (root == nullptr) return;
+        for (size_type j = 0; j <= root->size; ++j) {
+            destroy(root->children.at(j));
+        }
+        m_pool.destroy(root);
     }
 
-    bool contains(Node* root, key_type key) {
-        if (root == nullptr) {
-            return false;
+    // Finds the smallest and largest keys again at the ends of the tree.
+    void find_extremes() {
+        if (m_root == nullptr || m_root->size == 0) return;
+        auto node = m_root;
+        while (node->children.at(0) != nullptr) {
+            node = node->children.at(0);
+        }
+        m_min = node->keys.at(0);
+        node = m_root;
+        while (node->children.at(0) != nullptr) {
+            node = node->children.at(node->size);
+        }
+        m_max = node->keys.at(node->size-1);
+    }
+
+    // Removes the n smallest keys, or the n largest if Max, appending them
+    // to keys from the outermost in. Whole subtrees and keys are cut off the
+    // edge of the tree a level at a time, down to the node where the subtree
+    // counts say the last of them is, which leaves the nodes down the edge
+    // short of keys. They are refilled from the root down, as in remove(), so
+    // that each can spare a key when the child below it merges.
+    template <bool Max>
+    void pop(size_type n, std::vector<key_type>& keys) {
+        m_size -= n;
+        ++m_version;
+
+        std::array<Node*, 64> path;
+        size_type depth = 0;
+        auto node = m_root;
+        while (true) {
+            path.at(depth++) = node;
+
+            size_type cut = 0;
+            while (cut < node->size) {
+                const auto i = Max ? node->size - cut : cut;
+                if (n <= node->counts.at(i)) break;
+                collect<Max>(node->children.at(i), keys);
+                keys.push_back(node->keys.at(Max ? i - 1 : i));
+                destroy(node->children.at(i));
+                n -= node->counts.at(i) + 1;
+                ++cut;
+            }
+
+            if (!Max) {
+                for (size_type j = 0; j + cut < node->size; ++j) {
+                    node->keys.at(j) = node->keys.at(j+cut);
+                    node->children.at(j) = node->children.at(j+cut);
+                }
+                node->children.at(node->size-cut) = node->children.at(node->size);
+            }
+            for (size_type j = node->size - cut; j < node->size; ++j) {
+                node->keys.at(j) = 0;
+                node->children.at(j+1) = nullptr;
+            }
+            node->size -= cut;
+
+            if (n == 0 || node->children.at(0) == nullptr) break;
+            node = node->children.at(Max ? node->size : 0);
+        }
+        assert(n == 0);
+        while (depth > 0) {
+            refresh(path.at(--depth));
+        }
+
+        while (m_root->size == 0 && m_root->children.at(0) != nullptr) {
+            shrink();
+        }
+        node = m_root;
+        while (node->children.at(0) != nullptr) {
+            auto i = Max ? node->size : 0;
+            while (node->children.at(i)->size < B/2) {
+                if (node->children.at(Max ? i - 1 : i + 1)->size > B/2 - 1) {
+                    if (Max) {
+                        borrow_left(node, i);
+                    } else {
+                        borrow_right(node, i);
+                    }
+                } else {
+                    if (Max) --i;
+                    merge(node, i);
+                    break;
+                }
+            }
+            if (node == m_root && node->size == 0) {
+                node = shrink();
+                continue;
+            }
+            node = node->children.at(i);
+        }
+
+        find_extremes();
+    }
+
+    // Lists the subtrees `depth` levels below the root in order, with the
+    // keys that separate them, and the nodes above them.
+    static void frontier(Node* root, size_type depth, std::vector<Node*>& subtrees, std::vector<key_type>& separators, std::vector<Node*>& above) {
+        if (depth == 0) {
+            subtrees.push_back(root);
+            return;
+        }
+
+        above.push_back(root);
+        for (size_type j = 0; j <= root->size; ++j) {
+            frontier(root->children.at(j), depth-1, subtrees, separators, above);
+            if (j < root->size) {
+                separators.push_back(root->keys.at(j));
+            }
         }
+    }
 
+    // Brings the subtrees whose roots are below the minimum size up to it,
+    // by merging them with or borrowing from a neighbour through a
+    // temporary parent. The subtrees all have the same height.
+    void fill(std::vector<Node*>& subtrees, std::vector<key_type>& separators) {
         size_type i = 0;
-        while (i < root->size && root->keys.at(i) < key) ++i;
-        if (i < root->size && root->keys.at(i) == key) {
-            return true;
+        while (i < subtrees.size()) {
+            if (subtrees.size() == 1 || subtrees[i]->size >= B/2 - 1) {
+                ++i;
+                continue;
+            }
+
+            // Pair the subtree with its right neighbour, or its left one.
+            auto j = i + 1 < subtrees.size() ? i : i - 1;
+            auto parent = m_pool.create();
+            parent->keys.at(0) = separators[j];
+            parent->children.at(0) = subtrees[j];
+            parent->children.at(1) = subtrees[j+1];
+            parent->size = 1;
+
+            if (subtrees[j]->size + subtrees[j+1]->size < B-1) {
+                merge(parent, 0);
+                subtrees.erase(subtrees.begin() + j + 1);
+                separators.erase(separators.begin() + j);
+            } else {
+                if (subtrees[j]->size < subtrees[j+1]->size) {
+                    borrow_right(parent, 0);
+                } else {
+                    borrow_left(parent, 1);
+                }
+                separators[j] = parent->keys.at(0);
+            }
+            m_pool.destroy(parent);
+            i = j;
         }
+    }
 
-        return contains(root->children.at(i), key);
+    // Builds levels of new nodes over subtrees of the same height, with as
+    // few nodes per level as can hold them and the subtrees spread evenly,
+    // until a single root is left.
+    Node* stack(std::vector<Node*> subtrees, std::vector<key_type> separators) {
+        while (subtrees.size() > 1) {
+            const auto count = subtrees.size();
+            const auto parents = (count + B - 1) / B;
+
+            std::vector<Node*> level;
+            std::vector<key_type> level_separators;
+            size_type next = 0;
+            for (size_type p = 0; p < parents; ++p) {
+                const auto children = count / parents + (p < count % parents);
+                auto parent = m_pool.create();
+                for (size_type j = 0; j < children; ++j) {
+                    parent->children.at(j) = subtrees[next+j];
+                    if (j + 1 < children) {
+                        parent->keys.at(j) = separators[next+j];
+                    }
+                }
+                parent->size = children - 1;
+                refresh(parent);
+
+                next += children;
+                if (p + 1 < parents) {
+                    level_separators.push_back(separators[next-1]);
+                }
+                level.push_back(parent);
+            }
+
+            subtrees = std::move(level);
+            separators = std::move(level_separators);
+        }
+        return subtrees[0];
+    }
+
+    // Replaces the tree with one built from its keys merged with a batch at
+    // least as large.
+    void rebuild(const std::vector<key_type>& keys, bool insert, size_type threads) {
+        std::vector<key_type> current;
+        current.reserve(m_size);
+        collect(m_root, current);
+
+        std::vector<key_type> merged;
+        if (insert) {
+            std::set_union(current.begin(), current.end(), keys.begin(), keys.end(), std::back_inserter(merged));
+        } else {
+            std::set_difference(current.begin(), current.end(), keys.begin(), keys.end(), std::back_inserter(merged));
+        }
+
+        NodePool<Node> pool(m_pool.pages());
+        if (merged.empty()) {
+            m_root = pool.create();
+        } else {
+            size_type height = 1;
+            while (capacity(height) < merged.size()) ++height;
+            m_root = build(merged, 0, merged.size(), height, threads, pool);
+        }
+        m_pool = std::move(pool);
+        m_size = merged.size();
+        ++m_version;
+    }
+
+    // Applies a sorted batch without duplicates in parallel. The tree is cut
+    // at the first level with enough subtrees to go around the threads, each
+    // subtree takes its share of the batch as a tree of its own, and new
+    // levels are built over the results.
+    void update_parallel(const std::vector<key_type>& keys, bool insert, size_type threads) {
+        const auto levels = height(m_root);
+        std::vector<Node*> level{m_root};
+        size_type depth = 0;
+        while (depth + 1 < levels && level.size() < TASKS_PER_THREAD * threads) {
+            std::vector<Node*> below;
+            for (const auto node : level) {
+                for (size_type j = 0; j <= node->size; ++j) {
+                    below.push_back(node->children.at(j));
+                }
+            }
+            level = std::move(below);
+            ++depth;
+        }
+
+        std::vector<Node*> subtrees;
+        std::vector<key_type> separators;
+        std::vector<Node*> above;
+        frontier(m_root, depth, subtrees, separators, above);
+
+        // Split the batch between the subtrees. Keys that are separators
+        // stay in the levels above, which are updated afterwards.
+        std::vector<size_type> begin(subtrees.size());
+        std::vector<size_type> end(subtrees.size());
+        std::vector<key_type> batch;
+        std::vector<key_type> hits;
+        batch.reserve(keys.size());
+        size_type k = 0;
+        for (size_type i = 0; i < subtrees.size(); ++i) {
+            begin[i] = batch.size();
+            while (k < keys.size() && (i == separators.size() || keys[k] < separators[i])) {
+                batch.push_back(keys[k++]);
+            }
+            end[i] = batch.size();
+            if (i < separators.size() && k < keys.size() && keys[k] == separators[i]) {
+                hits.push_back(keys[k++]);
+            }
+        }
+
+        // Each subtree is updated as a tree with a pool of its own, so it may
+        // grow or shrink by levels. These pools only hold the nodes a share
+        // of the batch adds, so they take normal pages even for a huge-page
+        // tree, rather than a 2MB mapping each.
+        std::vector<Node*> roots(subtrees.size());
+        std::vector<NodePool<Node>> pools(subtrees.size());
+        parallel_for_dynamic(subtrees.size(), threads, [&](size_type i) {
+            BTree part(nullptr, Pages::Normal);
+            part.m_root = subtrees[i];
+            Finger finger;
+            for (auto j = begin[i]; j < end[i]; ++j) {
+                if (insert) {
+                    part.insert(finger, batch[j]);
+                } else {
+                    part.remove(batch[j]);
+                }
+            }
+            roots[i] = part.m_root;
+            pools[i] = std::move(part.m_pool);
+        });
+        for (auto& pool : pools) {
+            m_pool.adopt(std::move(pool));
+        }
+        for (const auto node : above) {
+            m_pool.destroy(node);
+        }
+
+        // Drop the subtrees that were emptied. Of the separators around
+        // them one stays and the others go back in afterwards.
+        std::vector<Node*> kept;
+        std::vector<key_type> kept_separators;
+        std::vector<key_type> gap;
+        std::vector<key_type> reinserts;
+        for (size_type i = 0; i < roots.size(); ++i) {
+            if (i > 0) gap.push_back(separators[i-1]);
+            if (roots[i]->size == 0) {
+                m_pool.destroy(roots[i]);
+                continue;
+            }
+            if (!kept.empty()) {
+                kept_separators.push_back(gap.back());
+                gap.pop_back();
+            }
+            reinserts.insert(reinserts.end(), gap.begin(), gap.end());
+            gap.clear();
+            kept.push_back(roots[i]);
+        }
+        reinserts.insert(reinserts.end(), gap.begin(), gap.end());
+
+        if (kept.empty()) {
+            m_root = m_pool.create();
+        } else {
+            // Cut the taller subtrees down to the height of the shortest.
+            size_type shortest = height(kept[0]);
+            for (const auto root : kept) {
+                shortest = std::min(shortest, height(root));
+            }
+
+            std::vector<Node*> even;
+            std::vector<key_type> even_separators;
+            for (size_type i = 0; i < kept.size(); ++i) {
+                if (i > 0) even_separators.push_back(kept_separators[i-1]);
+                std::vector<Node*> tops;
+                frontier(kept[i], height(kept[i]) - shortest, even, even_separators, tops);
+                for (const auto node : tops) {
+                    m_pool.destroy(node);
+                }
+            }
+
+            fill(even, even_separators);
+            m_root = stack(std::move(even), std::move(even_separators));
+        }
+        m_size = count(m_root);
+        ++m_version;
+
+        for (const auto key : reinserts) {
+            this->insert(key);
+        }
+        if (!insert) {
+            for (const auto key : hits) {
+                remove(key);
+            }
+        }
+    }
+
+    void update_batch(const std::vector<key_type>& keys, bool insert, size_type threads) {
+        if (keys.empty()) return;
+
+        if (keys.size() >= m_size) {
+            rebuild(keys, insert, threads);
+        } else if (threads > 1 && keys.size() >= PARALLEL_BATCH && height(m_root) > 1) {
+            update_parallel(keys, insert, threads);
+        } else {
+            // Sorted keys are close together, so a finger saves most of
+            // each descent.
+            Finger finger;
+            for (const auto key : keys) {
+                if (insert) {
+                    this->insert(finger, key);
+                } else {
+                    remove(key);
+                }
+            }
+        }
+        find_extremes();
     }
 
 public:
-    BTree() : m_root(new Node()), m_size(0) {}
+    BTree() : m_root(nullptr), m_size(0), m_min(0), m_max(0), m_version(0) {}
+
+    // A tree whose nodes are allocated from pages of the given kind.
+    explicit BTree(Pages pages) : m_pool(pages), m_root(nullptr), m_size(0), m_min(0), m_max(0), m_version(0) {}
+
+    // Copying is explicit, through clone().
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    // The other tree is left empty, without any memory of its own.
+    BTree(BTree&& other) noexcept
+        : m_pool(std::move(other.m_pool)), m_root(std::exchange(other.m_root, nullptr)),
+          m_size(std::exchange(other.m_size, 0)), m_min(other.m_min), m_max(other.m_max),
+          m_version(++other.m_version) {}
+
+    BTree& operator=(BTree&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    // Fingers into either tree go stale, since both versions move past the
+    // versions they were taken at.
+    void swap(BTree& other) noexcept {
+        const auto version = std::max(m_version, other.m_version) + 1;
+        m_pool.swap(other.m_pool);
+        std::swap(m_root, other.m_root);
+        std::swap(m_size, other.m_size);
+        std::swap(m_min, other.m_min);
+        std::swap(m_max, other.m_max);
+        m_version = other.m_version = version;
+    }
+
+    friend void swap(BTree& a, BTree& b) noexcept {
+        a.swap(b);
+    }
+
+    // Copies the tree into a single allocation, with the nodes laid out in
+    // depth-first order.
+    BTree clone() const {
+        BTree copy(nullptr, m_pool.pages());
+        copy.m_pool.reserve(nodes(m_root));
+        copy.m_root = clone(m_root, copy.m_pool);
+        copy.m_size = m_size;
+        copy.m_min = m_min;
+        copy.m_max = m_max;
+        return copy;
+    }
 
     void insert(key_type key) {
-        bool full = insert(m_root, key);
-        if (!full) return;
-        auto new_root = new Node();
-        new_root->children.at(0) = m_root;
-        split(new_root, 0);
-        m_root = new_root;
+        if (root()->size == B-1) {
+            grow();
+        }
+
+        Finger finger;
+        finger.path[0] = {m_root, 0, 0, 0, false, false};
+        if (insert(finger, 0, key)) {
+            account(finger, key);
+        }
+        ++m_version;
+    }
+
+    // Inserts the key starting from the leaf the finger was left at, and
+    // leaves the finger at the key. Runs of nearby keys, such as increasing or
+    // decreasing sequences, only walk up as far as the first node with room,
+    // although the subtree counts on the path above are still incremented.
+    void insert(Finger& finger, key_type key) {
+        // Start over from the root if the finger is stale.
+        if (finger.owner != this || finger.version != m_version || finger.depth == 0) {
+            finger.owner = this;
+            finger.path[0] = {root(), 0, 0, 0, false, false};
+            finger.depth = 1;
+            descend(finger, key);
+        }
+
+        // Walk up until the subtree can hold the key and has room for a key
+        // from a split child.
+        auto top = finger.depth - 1;
+        while (top > 0 && (!finger.path[top].holds(key) || finger.path[top].node->size == B-1)) {
+            --top;
+        }
+        if (top == 0 && m_root->size == B-1) {
+            grow();
+            finger.path[0] = {m_root, 0, 0, 0, false, false};
+        }
+
+        if (insert(finger, top, key)) {
+            account(finger, key);
+        }
+        finger.version = ++m_version;
     }
 
+    // Removes the key in a single pass. Every child is refilled before
+    // descending into it so that removing from a leaf never underflows.
     void remove(key_type key) {
-        remove(m_root, key);
-        // cases:
-        // if not leaf -> put in leaf by switching with successor
-        // remove from leaf -> merge with sibling if too small
+        if (m_root == nullptr) return;
+        ++m_version;
+        const auto target = key;
+
+        // The slots on the path, and the key each one loses.
+        std::array<std::pair<Node*, size_type>, 64> path;
+        std::array<key_type, 64> removed;
+        size_type depth = 0;
+
+        auto node = m_root;
+        while (true) {
+            size_type i = 0;
+            while (i < node->size && node->keys.at(i) < key) ++i;
+            bool found = i < node->size && node->keys.at(i) == key;
+
+            // If the node is a leaf, remove the key in place.
+            if (node->children.at(0) == nullptr) {
+                if (!found) {
+                    return;
+                }
+
+                for (size_type j = i; j + 1 < node->size; ++j) {
+                    node->keys.at(j) = node->keys.at(j+1);
+                }
+                node->keys.at(node->size-1) = 0;
+                --(node->size);
+                --m_size;
+                break;
+            }
 
-        // to fixup try to pull keys from siblings to maintain >= b/2-1
-        // if not possible, merge the nodes together (this impacts parent)
+            // If the key is in an internal node, replace it with its
+            // predecessor or successor from a child that can spare a key,
+            // and remove that instead. If neither can, merge them around the
+            // key and remove it from the merged node.
+            if (found) {
+                if (node->children.at(i)->size > (B/2 - 1)) {
+                    auto pred = node->children.at(i);
+                    while (pred->children.at(0) != nullptr) {
+                        pred = pred->children.at(pred->size);
+                    }
+                    key = pred->keys.at(pred->size-1);
+                    node->keys.at(i) = key;
+                } else if (node->children.at(i+1)->size > (B/2 - 1)) {
+                    auto succ = node->children.at(i+1);
+                    while (succ->children.at(0) != nullptr) {
+                        succ = succ->children.at(0);
+                    }
+                    key = succ->keys.at(0);
+                    node->keys.at(i) = key;
+                    ++i;
+                } else {
+                    merge(node, i);
+                    if (node == m_root && node->size == 0) {
+                        node = shrink();
+                        continue;
+                    }
+                }
+            } else {
+                i = refill(node, i);
+                if (node == m_root && node->size == 0) {
+                    node = shrink();
+                    continue;
+                }
+            }
+
+            path.at(depth) = {node, i};
+            removed.at(depth) = key;
+            ++depth;
+            node = node->children.at(i);
+        }
+
+        for (size_type l = 0; l < depth; ++l) {
+            account(path.at(l).first, path.at(l).second, removed.at(l), false);
+        }
+
+        // Only removing an end of the tree needs a walk to the new end.
+        if (target == m_min || target == m_max) {
+            find_extremes();
+        }
     }
 
-    bool contains(key_type key) {
+    bool contains(key_type key) const {
         return contains(m_root, key);
     }
 
-    size_type size() {
+    std::optional<key_type> predecessor(key_type key) const {
+        return predecessor(m_root, key);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        return successor(m_root, key);
+    }
+
+    size_type size() const {
         return m_size;
     }
 
-    void print() { 
-        std::cout << "*** TREE ***" << std::endl;
-        print(m_root, 0);
-        std::cout << "*** END TREE ***" << std::endl;
-        std::cout << std::endl;
+    // The smallest key, kept up to date by every update.
+    std::optional<key_type> min() const {
+        if (m_size == 0) return std::nullopt;
+        return m_min;
     }
-private:
-    void print(Node* root, int depth) {
-        if (root == nullptr) return;
-        for (int j = 0; j < root->size; ++j) {
-            print(root->children[j], depth+1);
-            for (int i = 0; i < depth; ++i) {
-                std::cout << "\t";
-            }
-            std::cout << root->keys[j] << std::endl;
 
-            for (int i = root->size; i < B; ++i) {
-                assert(root->keys[i] == 0);
-            }
+    std::optional<key_type> max() const {
+        if (m_size == 0) return std::nullopt;
+        return m_max;
+    }
+
+    // Removes the n smallest keys, or all of them if there are fewer, and
+    // returns them in increasing order. Takes O(n + log size) time rather
+    // than a removal per key.
+    std::vector<key_type> pop_min(size_type n) {
+        n = std::min(n, m_size);
+        std::vector<key_type> keys;
+        keys.reserve(n);
+        if (n > 0) pop<false>(n, keys);
+        return keys;
+    }
 
-            for (int i = root->size+1; i < B+1; ++i) {
-                assert(root->children[B] == nullptr);
+    // Removes the n largest keys and returns them in decreasing order.
+    std::vector<key_type> pop_max(size_type n) {
+        n = std::min(n, m_size);
+        std::vector<key_type> keys;
+        keys.reserve(n);
+        if (n > 0) pop<true>(n, keys);
+        return keys;
+    }
+
+    // The number of keys less than the key.
+    size_type rank(key_type key) const {
+        return rank(m_root, key);
+    }
+
+    // The number of keys in [lo, hi).
+    size_type count_range(key_type lo, key_type hi) const {
+        if (hi <= lo) return 0;
+        return rank(hi) - rank(lo);
+    }
+
+    // The k-th smallest key, counting from zero.
+    std::optional<key_type> select(size_type k) const {
+        if (k >= m_size) {
+            return std::nullopt;
+        }
+
+        auto root = m_root;
+        while (true) {
+            size_type i = 0;
+            while (k >= root->counts.at(i)) {
+                k -= root->counts.at(i);
+                if (k == 0) return root->keys.at(i);
+                --k;
+                ++i;
             }
+            root = root->children.at(i);
         }
-        print(root->children[root->size], depth+1);
+    }
+
+#if BTREE_SUMS
+    // The sum of the keys in [lo, hi), modulo 2^64.
+    key_type sum_range(key_type lo, key_type hi) const {
+        if (hi <= lo) return 0;
+        return prefix_sum(m_root, hi) - prefix_sum(m_root, lo);
+    }
+#endif
+
+    // Builds the tree from unsorted keys that may contain duplicates, using up
+    // to the given number of threads. The tree must be empty.
+    template <class Iterator>
+    void build_parallel(Iterator first, Iterator last, size_type threads) {
+        assert(m_size == 0);
+        const auto keys = parallel_sort_unique(first, last, threads);
+        if (keys.empty()) return;
+
+        size_type height = 1;
+        while (capacity(height) < keys.size()) ++height;
+
+        destroy(m_root);
+        m_root = build(keys, 0, keys.size(), height, threads, m_pool);
+        m_size = keys.size();
+        m_min = keys.front();
+        m_max = keys.back();
+        ++m_version;
+    }
+
+    // Inserts a batch of keys, which may be unsorted and contain duplicates,
+    // using up to the given number of threads.
+    void insert_batch(const std::vector<key_type>& keys, size_type threads = std::thread::hardware_concurrency()) {
+        threads = std::max<size_type>(1, threads);
+        update_batch(parallel_sort_unique(keys.begin(), keys.end(), threads), true, threads);
+    }
+
+    void remove_batch(const std::vector<key_type>& keys, size_type threads = std::thread::hardware_concurrency()) {
+        threads = std::max<size_type>(1, threads);
+        update_batch(parallel_sort_unique(keys.begin(), keys.end(), threads), false, threads);
     }
 };
\ No newline at end of file
@@ -0,0 +1,489 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// A write-optimized B-epsilon tree. Keys live in the leaves, as in a B+ tree,
+// and every inner node keeps a buffer of pending inserts and removes for its
+// subtree. Updates land in the root's buffer and a full buffer moves the
+// messages for its busiest child down one level in a single batch, so each
+// node visit is shared by many updates. Queries read the buffers on the way
+// down, where a message higher up is always newer than one below it.
+//
+// invariants: all leaves are at the same depth, an inner node with k
+// children has k-1 pivots and child i holds keys in [pivots[i-1], pivots[i]).
+template <size_t Fanout = 16, size_t LeafSize = 64, size_t BufferSize = 256>
+class BeTree {
+public:
+    using size_type = size_t;
+    using key_type = uint64_t;
+
+    // Deep enough for any tree that fits in memory.
+    static constexpr size_type MAX_HEIGHT = 64;
+
+private:
+    struct Message {
+        key_type key;
+        bool insert;
+    };
+
+    struct Node {
+        // The keys of a leaf, or the pivots of an inner node.
+        std::vector<key_type> keys;
+        std::vector<Node*> children;
+
+        // Pending messages sorted by key, at most one per key.
+        std::vector<Message> buffer;
+
+        bool leaf() const {
+            return children.empty();
+        }
+    };
+
+    // Null until the first update, so that empty and moved-from trees own
+    // no memory.
+    Node* m_root;
+
+    // The number of messages moved down a level so far.
+    size_type m_flushed;
+
+    static bool less(const Message& message, key_type key) {
+        return message.key < key;
+    }
+
+    static size_type child_of(const Node* node, key_type key) {
+        return std::upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+    }
+
+    static bool oversized(const Node* node) {
+        return node->leaf() ? node->keys.size() > LeafSize : node->children.size() > Fanout;
+    }
+
+    static bool undersized(const Node* node) {
+        return node->leaf() ? node->keys.size() < LeafSize / 4 : node->children.size() < Fanout / 4;
+    }
+
+    // Merges newer messages over older ones.
+    static std::vector<Message> merge(const std::vector<Message>& older, const std::vector<Message>& newer) {
+        std::vector<Message> merged;
+        merged.reserve(older.size() + newer.size());
+        size_type i = 0;
+        size_type j = 0;
+        while (i < older.size() || j < newer.size()) {
+            if (j == newer.size() || (i < older.size() && older[i].key < newer[j].key)) {
+                merged.push_back(older[i++]);
+            } else {
+                if (i < older.size() && older[i].key == newer[j].key) ++i;
+                merged.push_back(newer[j++]);
+            }
+        }
+        return merged;
+    }
+
+    // Applies messages to the keys of a leaf.
+    static void apply(Node* leaf, const std::vector<Message>& messages) {
+        std::vector<key_type> keys;
+        keys.reserve(leaf->keys.size() + messages.size());
+        size_type i = 0;
+        size_type j = 0;
+        while (i < leaf->keys.size() || j < messages.size()) {
+            if (j == messages.size() || (i < leaf->keys.size() && leaf->keys[i] < messages[j].key)) {
+                keys.push_back(leaf->keys[i++]);
+            } else {
+                if (i < leaf->keys.size() && leaf->keys[i] == messages[j].key) ++i;
+                if (messages[j].insert) keys.push_back(messages[j].key);
+                ++j;
+            }
+        }
+        leaf->keys = std::move(keys);
+    }
+
+    // Splits the oversized child c into as many nodes as needed and links
+    // them into the node after it.
+    void split(Node* node, size_type c) {
+        auto child = node->children[c];
+        auto count = child->leaf() ? child->keys.size() : child->children.size();
+        auto limit = child->leaf() ? LeafSize : Fanout;
+        auto pieces = (count + limit - 1) / limit;
+
+        std::vector<key_type> pivots;
+        std::vector<Node*> nodes;
+        size_type begin = count / pieces + (0 < count % pieces);
+        for (size_type p = 1; p < pieces; ++p) {
+            auto end = begin + count / pieces + (p < count % pieces);
+            auto right = new Node();
+
+            if (child->leaf()) {
+                pivots.push_back(child->keys[begin]);
+                right->keys.assign(child->keys.begin() + begin, child->keys.begin() + end);
+            } else {
+                // The pivot between the pieces moves up.
+                pivots.push_back(child->keys[begin-1]);
+                right->keys.assign(child->keys.begin() + begin, child->keys.begin() + end - 1);
+                right->children.assign(child->children.begin() + begin, child->children.begin() + end);
+            }
+            nodes.push_back(right);
+            begin = end;
+        }
+
+        // Shrink the child to the first piece and hand out its messages.
+        begin = count / pieces + (0 < count % pieces);
+        if (child->leaf()) {
+            child->keys.resize(begin);
+        } else {
+            child->keys.resize(begin - 1);
+            child->children.resize(begin);
+
+            auto it = std::lower_bound(child->buffer.begin(), child->buffer.end(), pivots[0], less);
+            for (size_type p = 0; p < nodes.size(); ++p) {
+                auto last = p + 1 < pivots.size()
+                    ? std::lower_bound(it, child->buffer.end(), pivots[p+1], less)
+                    : child->buffer.end();
+                nodes[p]->buffer.assign(it, last);
+                it = last;
+            }
+            child->buffer.erase(std::lower_bound(child->buffer.begin(), child->buffer.end(), pivots[0], less), child->buffer.end());
+        }
+
+        node->keys.insert(node->keys.begin() + c, pivots.begin(), pivots.end());
+        node->children.insert(node->children.begin() + c + 1, nodes.begin(), nodes.end());
+    }
+
+    // Merges child c with a neighbour, splitting again if that is too big.
+    void merge(Node* node, size_type c) {
+        auto l = c > 0 ? c - 1 : c;
+        auto left = node->children[l];
+        auto right = node->children[l+1];
+
+        if (!left->leaf()) {
+            left->keys.push_back(node->keys[l]);
+            left->children.insert(left->children.end(), right->children.begin(), right->children.end());
+            left->buffer.insert(left->buffer.end(), right->buffer.begin(), right->buffer.end());
+        }
+        left->keys.insert(left->keys.end(), right->keys.begin(), right->keys.end());
+        delete right;
+
+        node->keys.erase(node->keys.begin() + l);
+        node->children.erase(node->children.begin() + l + 1);
+
+        if (oversized(left)) {
+            split(node, l);
+        }
+    }
+
+    // Restores the size bounds of child c after it changed.
+    void fix(Node* node, size_type c) {
+        if (oversized(node->children[c])) {
+            split(node, c);
+        } else if (undersized(node->children[c]) && node->children.size() > 1) {
+            merge(node, c);
+        }
+    }
+
+    // Moves the messages for the child with the most of them down a level.
+    void flush(Node* node) {
+        // Count the messages for each child.
+        size_type best = 0;
+        size_type best_begin = 0;
+        size_type best_end = 0;
+        size_type begin = 0;
+        for (size_type c = 0; c < node->children.size(); ++c) {
+            auto end = c < node->keys.size()
+                ? std::lower_bound(node->buffer.begin() + begin, node->buffer.end(), node->keys[c], less) - node->buffer.begin()
+                : node->buffer.size();
+            if (end - begin > best_end - best_begin) {
+                best = c;
+                best_begin = begin;
+                best_end = end;
+            }
+            begin = end;
+        }
+
+        std::vector<Message> messages(node->buffer.begin() + best_begin, node->buffer.begin() + best_end);
+        node->buffer.erase(node->buffer.begin() + best_begin, node->buffer.begin() + best_end);
+        m_flushed += messages.size();
+
+        auto child = node->children[best];
+        if (child->leaf()) {
+            apply(child, messages);
+        } else {
+            child->buffer = merge(child->buffer, messages);
+            while (child->buffer.size() > BufferSize) {
+                flush(child);
+            }
+        }
+        fix(node, best);
+    }
+
+    void upsert(Message message) {
+        if (m_root == nullptr) {
+            m_root = new Node();
+        }
+
+        if (m_root->leaf()) {
+            apply(m_root, {message});
+        } else {
+            auto& buffer = m_root->buffer;
+            auto it = std::lower_bound(buffer.begin(), buffer.end(), message.key, less);
+            if (it != buffer.end() && it->key == message.key) {
+                *it = message;
+            } else {
+                buffer.insert(it, message);
+            }
+            while (buffer.size() > BufferSize) {
+                flush(m_root);
+            }
+        }
+
+        // Grow a new root above an oversized root.
+        if (oversized(m_root)) {
+            auto root = new Node();
+            root->children.push_back(m_root);
+            m_root = root;
+            split(m_root, 0);
+        }
+
+        // Collapse a root with a single child once its buffer is empty.
+        while (!m_root->leaf() && m_root->children.size() == 1 && m_root->buffer.empty()) {
+            auto root = m_root;
+            m_root = root->children[0];
+            delete root;
+        }
+    }
+
+    // A run of messages from one buffer above the current node.
+    struct Span {
+        const Message* first;
+        const Message* last;
+    };
+
+    // Narrows the spans from above and the node's own buffer to the range
+    // of child c. The node's buffer is older, so it goes last.
+    static size_type narrow(const Node* node, size_type c, const Span* spans, size_type depth, Span* out) {
+        for (size_type d = 0; d <= depth; ++d) {
+            auto span = d < depth
+                ? spans[d]
+                : Span{node->buffer.data(), node->buffer.data() + node->buffer.size()};
+            if (c > 0) {
+                span.first = std::lower_bound(span.first, span.last, node->keys[c-1], less);
+            }
+            if (c < node->keys.size()) {
+                span.last = std::lower_bound(span.first, span.last, node->keys[c], less);
+            }
+            out[d] = span;
+        }
+        return depth + 1;
+    }
+
+    // Whether the key is live, given the newest span that mentions it.
+    static bool live(key_type key, const Span* spans, size_type depth) {
+        for (size_type d = 0; d < depth; ++d) {
+            auto it = std::lower_bound(spans[d].first, spans[d].last, key, less);
+            if (it != spans[d].last && it->key == key) {
+                return it->insert;
+            }
+        }
+        return true;
+    }
+
+    // The largest live key below the bound in the subtree, where the spans
+    // hold the messages for the subtree from the buffers above, newest first.
+    std::optional<key_type> predecessor(const Node* node, key_type bound, const Span* spans, size_type depth) const {
+        if (node->leaf()) {
+            // Merge the leaf and the spans downwards from the bound until a
+            // mentioned key is live.
+            Span cursors[MAX_HEIGHT];
+            for (size_type d = 0; d < depth; ++d) {
+                cursors[d] = {spans[d].first, std::lower_bound(spans[d].first, spans[d].last, bound, less)};
+            }
+            auto first = node->keys.data();
+            auto last = std::lower_bound(first, first + node->keys.size(), bound);
+
+            while (true) {
+                std::optional<key_type> key;
+                if (last != first) key = *(last-1);
+                for (size_type d = 0; d < depth; ++d) {
+                    if (cursors[d].last != cursors[d].first && (!key.has_value() || *key < (cursors[d].last-1)->key)) {
+                        key = (cursors[d].last-1)->key;
+                    }
+                }
+                if (!key.has_value() || live(*key, cursors, depth)) {
+                    return key;
+                }
+
+                if (last != first && *(last-1) == *key) --last;
+                for (size_type d = 0; d < depth; ++d) {
+                    if (cursors[d].last != cursors[d].first && (cursors[d].last-1)->key == *key) --cursors[d].last;
+                }
+            }
+        }
+
+        // Everything in an earlier child is below the bound.
+        Span narrowed[MAX_HEIGHT];
+        for (auto c = child_of(node, bound) + 1; c-- > 0; ) {
+            auto count = narrow(node, c, spans, depth, narrowed);
+            auto pred = predecessor(node->children[c], bound, narrowed, count);
+            if (pred.has_value()) {
+                return pred;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // The smallest live key above the bound in the subtree.
+    std::optional<key_type> successor(const Node* node, key_type bound, const Span* spans, size_type depth) const {
+        auto after = [](key_type key, const Message& message) { return key < message.key; };
+
+        if (node->leaf()) {
+            Span cursors[MAX_HEIGHT];
+            for (size_type d = 0; d < depth; ++d) {
+                cursors[d] = {std::upper_bound(spans[d].first, spans[d].last, bound, after), spans[d].last};
+            }
+            auto last = node->keys.data() + node->keys.size();
+            auto first = std::upper_bound(node->keys.data(), last, bound);
+
+            while (true) {
+                std::optional<key_type> key;
+                if (first != last) key = *first;
+                for (size_type d = 0; d < depth; ++d) {
+                    if (cursors[d].first != cursors[d].last && (!key.has_value() || cursors[d].first->key < *key)) {
+                        key = cursors[d].first->key;
+                    }
+                }
+                if (!key.has_value() || live(*key, cursors, depth)) {
+                    return key;
+                }
+
+                if (first != last && *first == *key) ++first;
+                for (size_type d = 0; d < depth; ++d) {
+                    if (cursors[d].first != cursors[d].last && cursors[d].first->key == *key) ++cursors[d].first;
+                }
+            }
+        }
+
+        // Everything in a later child is above the bound.
+        Span narrowed[MAX_HEIGHT];
+        for (auto c = child_of(node, bound); c < node->children.size(); ++c) {
+            auto count = narrow(node, c, spans, depth, narrowed);
+            auto succ = successor(node->children[c], bound, narrowed, count);
+            if (succ.has_value()) {
+                return succ;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Counts the live keys in the subtree, given the newer messages for it
+    // from the buffers above.
+    size_type count(const Node* node, const std::vector<Message>& pending) const {
+        if (node->leaf()) {
+            size_type count = node->keys.size();
+            for (const auto& message : pending) {
+                auto present = std::binary_search(node->keys.begin(), node->keys.end(), message.key);
+                count += message.insert && !present;
+                count -= !message.insert && present;
+            }
+            return count;
+        }
+
+        auto messages = merge(node->buffer, pending);
+        size_type count = 0;
+        auto it = messages.begin();
+        for (size_type c = 0; c < node->children.size(); ++c) {
+            auto end = c < node->keys.size()
+                ? std::lower_bound(it, messages.end(), node->keys[c], less)
+                : messages.end();
+            count += this->count(node->children[c], std::vector<Message>(it, end));
+            it = end;
+        }
+        return count;
+    }
+
+    void destroy(Node* node) {
+        if (node == nullptr) return;
+        for (auto child : node->children) {
+            destroy(child);
+        }
+        delete node;
+    }
+
+public:
+    BeTree() : m_root(nullptr), m_flushed(0) {}
+
+    BeTree(const BeTree&) = delete;
+    BeTree& operator=(const BeTree&) = delete;
+
+    BeTree(BeTree&& other) noexcept : m_root(other.m_root), m_flushed(other.m_flushed) {
+        other.m_root = nullptr;
+        other.m_flushed = 0;
+    }
+
+    BeTree& operator=(BeTree&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    void swap(BeTree& other) noexcept {
+        std::swap(m_root, other.m_root);
+        std::swap(m_flushed, other.m_flushed);
+    }
+
+    friend void swap(BeTree& a, BeTree& b) noexcept {
+        a.swap(b);
+    }
+
+    ~BeTree() {
+        destroy(m_root);
+    }
+
+    bool contains(key_type key) const {
+        if (m_root == nullptr) return false;
+
+        // The first message found on the way down is the newest.
+        auto node = m_root;
+        while (!node->leaf()) {
+            auto it = std::lower_bound(node->buffer.begin(), node->buffer.end(), key, less);
+            if (it != node->buffer.end() && it->key == key) {
+                return it->insert;
+            }
+            node = node->children[child_of(node, key)];
+        }
+        return std::binary_search(node->keys.begin(), node->keys.end(), key);
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        if (m_root == nullptr) return std::nullopt;
+        return predecessor(m_root, key, nullptr, 0);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        if (m_root == nullptr) return std::nullopt;
+        return successor(m_root, key, nullptr, 0);
+    }
+
+    // Updates are blind, so counting merges every pending message into the
+    // leaves below it. This takes linear time.
+    size_type size() const {
+        if (m_root == nullptr) return 0;
+        return count(m_root, {});
+    }
+
+    void insert(key_type key) {
+        upsert({key, true});
+    }
+
+    void remove(key_type key) {
+        upsert({key, false});
+    }
+
+    // The number of messages moved down a level so far. Divided by the
+    // number of updates, this is the write amplification of the buffers.
+    size_type flushed() const {
+        return m_flushed;
+    }
+};
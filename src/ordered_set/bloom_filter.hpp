@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// A counting Bloom filter whose counters for a key all live in one cache
+// line, so a lookup costs a single miss. Counters are four bits wide and
+// stick once they saturate, which keeps removals from ever causing a false
+// negative at the price of a few extra false positives.
+class CountingBloomFilter {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr size_type COUNTER_BITS = 4;
+    static constexpr size_type MAX_HASHES = 8;
+
+private:
+    static constexpr uint64_t SATURATED = (1 << COUNTER_BITS) - 1;
+
+    // 128 counters per 64 byte block.
+    static constexpr size_type WORDS = 8;
+    static constexpr size_type COUNTERS = WORDS * 64 / COUNTER_BITS;
+
+    struct alignas(64) Block {
+        std::array<uint64_t, WORDS> words;
+    };
+
+    std::vector<Block> m_blocks;
+    size_type m_hashes;
+
+    // The finalizer of splitmix64.
+    static uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    Block& block_of(uint64_t hash) {
+        return m_blocks[(static_cast<__uint128_t>(hash) * m_blocks.size()) >> 64];
+    }
+
+    const Block& block_of(uint64_t hash) const {
+        return m_blocks[(static_cast<__uint128_t>(hash) * m_blocks.size()) >> 64];
+    }
+
+    // The i-th counter of the key within its block, from seven bits of a
+    // second hash each.
+    static size_type counter_of(uint64_t hash, size_type i) {
+        return (hash >> (7 * i)) % COUNTERS;
+    }
+
+    static uint64_t get(const Block& block, size_type counter) {
+        return (block.words[counter / 16] >> (counter % 16 * COUNTER_BITS)) & SATURATED;
+    }
+
+    static void add(Block& block, size_type counter, int64_t delta) {
+        auto shift = counter % 16 * COUNTER_BITS;
+        block.words[counter / 16] += static_cast<uint64_t>(delta) << shift;
+    }
+
+public:
+    // Sized for the capacity at the given number of counters per key, of
+    // which each key sets `hashes`. Memory is COUNTER_BITS bits per counter.
+    CountingBloomFilter(size_type capacity, size_type counters_per_key, size_type hashes)
+        : m_blocks(std::max<size_type>(1, (capacity * counters_per_key + COUNTERS - 1) / COUNTERS)),
+          m_hashes(std::clamp<size_type>(hashes, 1, MAX_HASHES)) {}
+
+    void insert(key_type key) {
+        auto hash = mix(key);
+        auto& block = block_of(hash);
+        auto counters = mix(hash);
+        for (size_type i = 0; i < m_hashes; ++i) {
+            auto counter = counter_of(counters, i);
+            if (get(block, counter) != SATURATED) add(block, counter, 1);
+        }
+    }
+
+    // Only for keys that were inserted.
+    void remove(key_type key) {
+        auto hash = mix(key);
+        auto& block = block_of(hash);
+        auto counters = mix(hash);
+        for (size_type i = 0; i < m_hashes; ++i) {
+            auto counter = counter_of(counters, i);
+            if (get(block, counter) != SATURATED) add(block, counter, -1);
+        }
+    }
+
+    // False means the key was definitely never inserted.
+    bool may_contain(key_type key) const {
+        auto hash = mix(key);
+        const auto& block = block_of(hash);
+        auto counters = mix(hash);
+        bool found = true;
+        for (size_type i = 0; i < m_hashes; ++i) {
+            found &= get(block, counter_of(counters, i)) != 0;
+        }
+        return found;
+    }
+
+    size_type memory() const {
+        return m_blocks.size() * sizeof(Block);
+    }
+};
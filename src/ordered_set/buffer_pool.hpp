@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Caches the pages of a file in a fixed number of frames. Callers pin a
+// page while they use it and say whether they changed it when they unpin
+// it; a frame is reused only once its page is unpinned, chosen by the clock
+// algorithm, and written back first if it is dirty. Pages are allocated
+// and freed here too, and freed pages are reused before the file grows.
+//
+// The file is created in the given directory and unlinked at once, so it
+// lives as long as the pool. An I/O error leaves no way to answer, so it
+// aborts.
+template <size_t PageSize>
+class BufferPool {
+public:
+    using page_id = uint64_t;
+    using size_type = size_t;
+
+private:
+    struct Frame {
+        page_id id;
+        uint32_t pins;
+        bool valid;
+        bool dirty;
+        bool referenced;
+    };
+
+    int m_fd;
+    std::byte* m_data;
+    std::vector<Frame> m_frames;
+    std::unordered_map<page_id, size_type> m_resident;
+    size_type m_hand;
+
+    page_id m_pages;
+    std::vector<page_id> m_free;
+
+    size_type m_reads;
+    size_type m_writes;
+
+    [[noreturn]] static void fail(const char* what) {
+        std::perror(what);
+        std::abort();
+    }
+
+    std::byte* data(size_type frame) const {
+        return m_data + frame * PageSize;
+    }
+
+    void write_back(size_type frame) {
+        auto& f = m_frames[frame];
+        if (!f.dirty) return;
+        if (pwrite(m_fd, data(frame), PageSize, f.id * PageSize) != static_cast<ssize_t>(PageSize)) {
+            fail("BufferPool: pwrite");
+        }
+        f.dirty = false;
+        ++m_writes;
+    }
+
+    // A frame with no page in it, evicting the first unpinned page the clock
+    // hand finds that has not been used since the hand last passed.
+    size_type victim() {
+        for (size_type step = 0; step < 2 * m_frames.size() + 1; ++step) {
+            auto& f = m_frames[m_hand];
+            const auto frame = m_hand;
+            m_hand = (m_hand + 1) % m_frames.size();
+
+            if (!f.valid) return frame;
+            if (f.pins > 0) continue;
+            if (f.referenced) {
+                f.referenced = false;
+                continue;
+            }
+
+            write_back(frame);
+            m_resident.erase(f.id);
+            f.valid = false;
+            return frame;
+        }
+        fail("BufferPool: every frame is pinned");
+    }
+
+    std::byte* pin(page_id id, bool read) {
+        auto it = m_resident.find(id);
+        if (it != m_resident.end()) {
+            auto& f = m_frames[it->second];
+            ++f.pins;
+            f.referenced = true;
+            return data(it->second);
+        }
+
+        const auto frame = victim();
+        if (read) {
+            if (pread(m_fd, data(frame), PageSize, id * PageSize) != static_cast<ssize_t>(PageSize)) {
+                fail("BufferPool: pread");
+            }
+            ++m_reads;
+        } else {
+            std::memset(data(frame), 0, PageSize);
+        }
+        m_frames[frame] = {id, 1, true, !read, true};
+        m_resident.emplace(id, frame);
+        return data(frame);
+    }
+
+public:
+    BufferPool(size_type frames, const std::string& directory)
+        : m_frames(frames, Frame{0, 0, false, false, false}), m_hand(0),
+          m_pages(0), m_reads(0), m_writes(0) {
+        auto path = directory + "/pages.XXXXXX";
+        m_fd = mkstemp(path.data());
+        if (m_fd < 0) fail("BufferPool: mkstemp");
+        unlink(path.c_str());
+
+        m_data = static_cast<std::byte*>(::operator new(frames * PageSize, std::align_val_t(PageSize)));
+        m_resident.reserve(frames);
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    BufferPool(BufferPool&& other) noexcept
+        : m_fd(-1), m_data(nullptr), m_hand(0), m_pages(0), m_reads(0), m_writes(0) {
+        swap(other);
+    }
+
+    BufferPool& operator=(BufferPool&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~BufferPool() {
+        if (m_data != nullptr) {
+            ::operator delete(m_data, m_frames.size() * PageSize, std::align_val_t(PageSize));
+        }
+        if (m_fd >= 0) close(m_fd);
+    }
+
+    void swap(BufferPool& other) noexcept {
+        std::swap(m_fd, other.m_fd);
+        std::swap(m_data, other.m_data);
+        std::swap(m_frames, other.m_frames);
+        std::swap(m_resident, other.m_resident);
+        std::swap(m_hand, other.m_hand);
+        std::swap(m_pages, other.m_pages);
+        std::swap(m_free, other.m_free);
+        std::swap(m_reads, other.m_reads);
+        std::swap(m_writes, other.m_writes);
+    }
+
+    // A page that is not in use, which holds zeroes until it is written.
+    page_id allocate() {
+        if (!m_free.empty()) {
+            auto id = m_free.back();
+            m_free.pop_back();
+            return id;
+        }
+        return m_pages++;
+    }
+
+    // The page must not be pinned.
+    void free(page_id id) {
+        auto it = m_resident.find(id);
+        if (it != m_resident.end()) {
+            m_frames[it->second].valid = false;
+            m_frames[it->second].dirty = false;
+            m_resident.erase(it);
+        }
+        m_free.push_back(id);
+    }
+
+    // Pins the page and returns its bytes, reading it in if need be.
+    std::byte* pin(page_id id) {
+        return pin(id, true);
+    }
+
+    // Pins a page that was just allocated, without reading it.
+    std::byte* pin_new(page_id id) {
+        return pin(id, false);
+    }
+
+    void unpin(page_id id, bool dirty) {
+        auto& f = m_frames[m_resident.at(id)];
+        assert(f.pins > 0);
+        f.pins -= 1;
+        f.dirty |= dirty;
+    }
+
+    // Asks the kernel to start reading a page that is not resident, so that
+    // pinning it soon after finds it in the page cache.
+    void prefetch(page_id id) {
+        if (m_resident.contains(id)) return;
+        posix_fadvise(m_fd, id * PageSize, PageSize, POSIX_FADV_WILLNEED);
+    }
+
+    // Writes every dirty page back.
+    void flush() {
+        for (size_type frame = 0; frame < m_frames.size(); ++frame) {
+            if (m_frames[frame].valid) write_back(frame);
+        }
+    }
+
+    size_type frames() const {
+        return m_frames.size();
+    }
+
+    // The pages read in and written back so far.
+    size_type reads() const {
+        return m_reads;
+    }
+
+    size_type writes() const {
+        return m_writes;
+    }
+
+    // The bytes of the frames, which is all the page data held in memory.
+    size_type memory() const {
+        return m_frames.size() * PageSize;
+    }
+};
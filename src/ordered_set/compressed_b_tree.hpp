@@ -0,0 +1,527 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// A B+ tree whose leaves store their keys with frame-of-reference coding:
+// the smallest key as a base and the rest as offsets from it, bit-packed at
+// the width of the largest offset into a fixed array of words. Clustered
+// keys then take a few bits each instead of eight bytes. Offsets keep the
+// order of the keys, so a leaf is binary searched in place by unpacking
+// only the offsets it probes.
+//
+// A leaf holds as many keys as fit at its width, so a leaf splits when a new
+// key widens it past its words as well as when it is full.
+template <size_t Fanout = 16, size_t LeafWords = 32>
+class CompressedBTree {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr size_type LEAF_BITS = LeafWords * 64;
+
+private:
+    struct Node {
+        bool leaf;
+    };
+
+    struct Leaf : Node {
+        key_type base;
+        uint32_t width;
+        uint32_t count;
+        std::array<uint64_t, LeafWords> words;
+
+        Leaf() : Node{true}, base(0), width(0), count(0), words{} {}
+    };
+
+    // Child i holds the keys in [pivots[i-1], pivots[i]).
+    struct Inner : Node {
+        std::vector<key_type> pivots;
+        std::vector<Node*> children;
+
+        Inner() : Node{false} {}
+    };
+
+    // Room for the keys of a leaf and one more. Distinct keys take at least
+    // a bit each, so a leaf holds at most LEAF_BITS of them.
+    using Keys = std::array<key_type, LEAF_BITS + 1>;
+
+    // The nodes that a split adds to the right of a node, with their
+    // smallest keys.
+    using Splits = std::vector<std::pair<key_type, Node*>>;
+
+    Node* m_root;
+    size_type m_size;
+
+    static Leaf* as_leaf(Node* node) {
+        return static_cast<Leaf*>(node);
+    }
+
+    static const Leaf* as_leaf(const Node* node) {
+        return static_cast<const Leaf*>(node);
+    }
+
+    static Inner* as_inner(Node* node) {
+        return static_cast<Inner*>(node);
+    }
+
+    static const Inner* as_inner(const Node* node) {
+        return static_cast<const Inner*>(node);
+    }
+
+    // The bits that count keys spanning [lo, hi] take in a leaf.
+    static size_type bits(size_type count, key_type lo, key_type hi) {
+        return count * std::bit_width(hi - lo);
+    }
+
+    static key_type get(const Leaf* leaf, size_type i) {
+        const auto width = leaf->width;
+        if (width == 0) {
+            return leaf->base;
+        }
+
+        // An offset may straddle two words.
+        const auto bit = i * width;
+        const auto word = bit / 64;
+        const auto shift = bit % 64;
+        auto offset = leaf->words[word] >> shift;
+        if (shift + width > 64) {
+            offset |= leaf->words[word+1] << (64 - shift);
+        }
+        if (width < 64) {
+            offset &= (uint64_t(1) << width) - 1;
+        }
+        return leaf->base + offset;
+    }
+
+    // Packs sorted keys into the leaf. They must fit.
+    static void encode(Leaf* leaf, const key_type* first, const key_type* last) {
+        const size_type count = last - first;
+        leaf->count = count;
+        leaf->base = count > 0 ? first[0] : 0;
+        leaf->width = count > 0 ? std::bit_width(last[-1] - first[0]) : 0;
+        leaf->words.fill(0);
+
+        const auto width = leaf->width;
+        for (size_type i = 0; width > 0 && i < count; ++i) {
+            const auto offset = first[i] - leaf->base;
+            const auto bit = i * width;
+            const auto word = bit / 64;
+            const auto shift = bit % 64;
+            leaf->words[word] |= offset << shift;
+            if (shift + width > 64) {
+                leaf->words[word+1] |= offset >> (64 - shift);
+            }
+        }
+    }
+
+    // Unpacks the keys of the leaf and returns how many there are.
+    static size_type decode(const Leaf* leaf, key_type* keys) {
+        for (size_type i = 0; i < leaf->count; ++i) {
+            keys[i] = get(leaf, i);
+        }
+        return leaf->count;
+    }
+
+    // The index of the first key not less than the key.
+    static size_type lower_bound(const Leaf* leaf, key_type key) {
+        size_type lo = 0;
+        size_type hi = leaf->count;
+        while (lo < hi) {
+            const auto mid = (lo + hi) / 2;
+            if (get(leaf, mid) < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    static size_type child_of(const Inner* inner, key_type key) {
+        return std::upper_bound(inner->pivots.begin(), inner->pivots.end(), key) - inner->pivots.begin();
+    }
+
+    // Refills the leaf with the keys, splitting off new leaves as needed.
+    // Two halves are tried first, and otherwise each leaf takes as many keys
+    // as fit, which separates clusters that are far apart. Appending skips
+    // the halves, so that ascending inserts leave full leaves behind.
+    static Splits pack(Leaf* leaf, const key_type* data, size_type size, bool appending) {
+        if (bits(size, data[0], data[size-1]) <= LEAF_BITS) {
+            encode(leaf, data, data + size);
+            return {};
+        }
+
+        std::vector<size_type> bounds = {0};
+        const auto half = size / 2;
+        if (
+            !appending
+            && bits(half, data[0], data[half-1]) <= LEAF_BITS
+            && bits(size - half, data[half], data[size-1]) <= LEAF_BITS
+        ) {
+            bounds.push_back(half);
+        } else {
+            size_type begin = 0;
+            for (size_type end = 1; end < size; ++end) {
+                if (bits(end - begin + 1, data[begin], data[end]) > LEAF_BITS) {
+                    bounds.push_back(end);
+                    begin = end;
+                }
+            }
+        }
+        bounds.push_back(size);
+
+        Splits splits;
+        encode(leaf, data, data + bounds[1]);
+        for (size_type i = 1; i + 1 < bounds.size(); ++i) {
+            auto right = new Leaf();
+            encode(right, data + bounds[i], data + bounds[i+1]);
+            splits.emplace_back(data[bounds[i]], right);
+        }
+        return splits;
+    }
+
+    // Splits an inner node with too many children into as few as needed.
+    static Splits split(Inner* inner) {
+        const auto count = inner->children.size();
+        const auto pieces = (count + Fanout - 1) / Fanout;
+
+        Splits splits;
+        size_type begin = count / pieces + (0 < count % pieces);
+        const auto first = begin;
+        for (size_type p = 1; p < pieces; ++p) {
+            const auto end = begin + count / pieces + (p < count % pieces);
+            auto right = new Inner();
+            right->pivots.assign(inner->pivots.begin() + begin, inner->pivots.begin() + end - 1);
+            right->children.assign(inner->children.begin() + begin, inner->children.begin() + end);
+            splits.emplace_back(inner->pivots[begin-1], right);
+            begin = end;
+        }
+        inner->pivots.resize(first - 1);
+        inner->children.resize(first);
+        return splits;
+    }
+
+    // Repacks the leaf with the key added at index i.
+    static Splits insert_at(Leaf* leaf, size_type i, key_type key) {
+        Keys keys;
+        const auto count = decode(leaf, keys.data());
+        std::copy_backward(keys.begin() + i, keys.begin() + count, keys.begin() + count + 1);
+        keys[i] = key;
+        return pack(leaf, keys.data(), count + 1, i == count);
+    }
+
+    // Fewer keys over a narrower range always fit.
+    static void remove_at(Leaf* leaf, size_type i) {
+        Keys keys;
+        const auto count = decode(leaf, keys.data());
+        std::copy(keys.begin() + i + 1, keys.begin() + count, keys.begin() + i);
+        encode(leaf, keys.data(), keys.data() + count - 1);
+    }
+
+    Splits insert(Node* node, key_type key) {
+        if (node->leaf) {
+            auto leaf = as_leaf(node);
+            const auto i = lower_bound(leaf, key);
+            if (i < leaf->count && get(leaf, i) == key) {
+                return {};
+            }
+
+            ++m_size;
+            return insert_at(leaf, i, key);
+        }
+
+        // Move down.
+        auto inner = as_inner(node);
+        const auto c = child_of(inner, key);
+        const auto splits = insert(inner->children[c], key);
+        if (splits.empty()) {
+            return {};
+        }
+
+        for (size_type i = 0; i < splits.size(); ++i) {
+            inner->pivots.insert(inner->pivots.begin() + c + i, splits[i].first);
+            inner->children.insert(inner->children.begin() + c + 1 + i, splits[i].second);
+        }
+        if (inner->children.size() <= Fanout) {
+            return {};
+        }
+        return split(inner);
+    }
+
+    // Merges child c with its right neighbour when the result would leave
+    // room to spare, so that the tree does not fill up with sparse nodes.
+    void merge(Inner* inner, size_type c) {
+        auto left = inner->children[c];
+        auto right = inner->children[c+1];
+
+        if (left->leaf) {
+            auto l = as_leaf(left);
+            auto r = as_leaf(right);
+            if (bits(l->count + r->count, l->base, get(r, r->count - 1)) * 4 > LEAF_BITS * 3) {
+                return;
+            }
+
+            Keys keys;
+            auto count = decode(l, keys.data());
+            count += decode(r, keys.data() + count);
+            encode(l, keys.data(), keys.data() + count);
+            delete r;
+        } else {
+            auto l = as_inner(left);
+            auto r = as_inner(right);
+            if ((l->children.size() + r->children.size()) * 4 > Fanout * 3) {
+                return;
+            }
+
+            l->pivots.push_back(inner->pivots[c]);
+            l->pivots.insert(l->pivots.end(), r->pivots.begin(), r->pivots.end());
+            l->children.insert(l->children.end(), r->children.begin(), r->children.end());
+            delete r;
+        }
+
+        inner->pivots.erase(inner->pivots.begin() + c);
+        inner->children.erase(inner->children.begin() + c + 1);
+    }
+
+    bool remove(Node* node, key_type key) {
+        if (node->leaf) {
+            auto leaf = as_leaf(node);
+            const auto i = lower_bound(leaf, key);
+            if (i == leaf->count || get(leaf, i) != key) {
+                return false;
+            }
+
+            remove_at(leaf, i);
+            --m_size;
+            return true;
+        }
+
+        // Move down.
+        auto inner = as_inner(node);
+        const auto c = child_of(inner, key);
+        if (!remove(inner->children[c], key)) {
+            return false;
+        }
+
+        // Drop an empty child, or try to merge it with a neighbour.
+        auto child = inner->children[c];
+        const auto empty = child->leaf ? as_leaf(child)->count == 0 : as_inner(child)->children.empty();
+        if (empty) {
+            destroy(child);
+            inner->children.erase(inner->children.begin() + c);
+            if (!inner->pivots.empty()) {
+                inner->pivots.erase(inner->pivots.begin() + (c > 0 ? c - 1 : 0));
+            }
+        } else if (inner->children.size() > 1) {
+            merge(inner, c + 1 < inner->children.size() ? c : c - 1);
+        }
+        return true;
+    }
+
+    static std::optional<key_type> max(const Node* node) {
+        while (!node->leaf) {
+            node = as_inner(node)->children.back();
+        }
+        const auto leaf = as_leaf(node);
+        return leaf->count > 0 ? std::make_optional(get(leaf, leaf->count - 1)) : std::nullopt;
+    }
+
+    static std::optional<key_type> min(const Node* node) {
+        while (!node->leaf) {
+            node = as_inner(node)->children.front();
+        }
+        const auto leaf = as_leaf(node);
+        return leaf->count > 0 ? std::make_optional(get(leaf, 0)) : std::nullopt;
+    }
+
+    static std::optional<key_type> predecessor(const Node* node, key_type key) {
+        if (node->leaf) {
+            const auto leaf = as_leaf(node);
+            const auto i = lower_bound(leaf, key);
+            return i > 0 ? std::make_optional(get(leaf, i - 1)) : std::nullopt;
+        }
+
+        // Children are never empty, so the one before has the answer if
+        // this one does not.
+        const auto inner = as_inner(node);
+        const auto c = child_of(inner, key);
+        auto pred = predecessor(inner->children[c], key);
+        if (!pred.has_value() && c > 0) {
+            pred = max(inner->children[c-1]);
+        }
+        return pred;
+    }
+
+    static std::optional<key_type> successor(const Node* node, key_type key) {
+        if (node->leaf) {
+            const auto leaf = as_leaf(node);
+            auto i = lower_bound(leaf, key);
+            if (i < leaf->count && get(leaf, i) == key) ++i;
+            return i < leaf->count ? std::make_optional(get(leaf, i)) : std::nullopt;
+        }
+
+        const auto inner = as_inner(node);
+        const auto c = child_of(inner, key);
+        auto succ = successor(inner->children[c], key);
+        if (!succ.has_value() && c + 1 < inner->children.size()) {
+            succ = min(inner->children[c+1]);
+        }
+        return succ;
+    }
+
+    static size_type memory(const Node* node) {
+        if (node == nullptr) {
+            return 0;
+        }
+        if (node->leaf) {
+            return sizeof(Leaf);
+        }
+
+        const auto inner = as_inner(node);
+        size_type bytes = sizeof(Inner)
+            + inner->pivots.capacity() * sizeof(key_type)
+            + inner->children.capacity() * sizeof(Node*);
+        for (const auto child : inner->children) {
+            bytes += memory(child);
+        }
+        return bytes;
+    }
+
+    static void destroy(Node* node) {
+        if (node == nullptr) {
+            return;
+        }
+        if (node->leaf) {
+            delete as_leaf(node);
+            return;
+        }
+
+        for (auto child : as_inner(node)->children) {
+            destroy(child);
+        }
+        delete as_inner(node);
+    }
+
+    // The root, which an empty tree only gets on its first insert, so that
+    // empty and moved-from trees own no memory.
+    Node* root() {
+        if (m_root == nullptr) {
+            m_root = new Leaf();
+        }
+        return m_root;
+    }
+
+public:
+    CompressedBTree() : m_root(nullptr), m_size(0) {}
+
+    CompressedBTree(const CompressedBTree&) = delete;
+    CompressedBTree& operator=(const CompressedBTree&) = delete;
+
+    CompressedBTree(CompressedBTree&& other) noexcept
+        : m_root(std::exchange(other.m_root, nullptr)), m_size(std::exchange(other.m_size, 0)) {}
+
+    CompressedBTree& operator=(CompressedBTree&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~CompressedBTree() {
+        destroy(m_root);
+    }
+
+    void swap(CompressedBTree& other) noexcept {
+        std::swap(m_root, other.m_root);
+        std::swap(m_size, other.m_size);
+    }
+
+    friend void swap(CompressedBTree& a, CompressedBTree& b) noexcept {
+        a.swap(b);
+    }
+
+    bool contains(key_type key) const {
+        if (m_root == nullptr) {
+            return false;
+        }
+
+        const Node* node = m_root;
+        while (!node->leaf) {
+            const auto inner = as_inner(node);
+            node = inner->children[child_of(inner, key)];
+        }
+
+        const auto leaf = as_leaf(node);
+        const auto i = lower_bound(leaf, key);
+        return i < leaf->count && get(leaf, i) == key;
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        if (m_root == nullptr) {
+            return std::nullopt;
+        }
+        return predecessor(m_root, key);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        if (m_root == nullptr) {
+            return std::nullopt;
+        }
+        return successor(m_root, key);
+    }
+
+    size_type size() const {
+        return m_size;
+    }
+
+    void insert(key_type key) {
+        const auto splits = insert(root(), key);
+        if (splits.empty()) {
+            return;
+        }
+
+        // Grow a new root above the pieces, splitting it again if needed.
+        auto root = new Inner();
+        root->children.push_back(m_root);
+        for (const auto& [pivot, node] : splits) {
+            root->pivots.push_back(pivot);
+            root->children.push_back(node);
+        }
+        m_root = root;
+
+        while (as_inner(m_root)->children.size() > Fanout) {
+            auto root = new Inner();
+            root->children.push_back(m_root);
+            for (const auto& [pivot, node] : split(as_inner(m_root))) {
+                root->pivots.push_back(pivot);
+                root->children.push_back(node);
+            }
+            m_root = root;
+        }
+    }
+
+    void remove(key_type key) {
+        if (m_root == nullptr) {
+            return;
+        }
+        remove(m_root, key);
+
+        // Collapse roots with a single child, and drop an empty inner root.
+        while (m_root != nullptr && !m_root->leaf && as_inner(m_root)->children.size() <= 1) {
+            auto root = as_inner(m_root);
+            m_root = root->children.empty() ? nullptr : root->children[0];
+            root->children.clear();
+            delete root;
+        }
+    }
+
+    // The bytes taken by all nodes.
+    size_type memory() const {
+        return memory(m_root);
+    }
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+// A small id for the calling thread, unique among live threads. Ids of
+// exited threads are handed out again, so they stay dense.
+inline size_t thread_slot() {
+    static std::mutex mutex;
+    static std::vector<size_t> released;
+    static size_t next = 0;
+
+    struct Id {
+        size_t value;
+
+        Id() {
+            std::lock_guard lock(mutex);
+            if (released.empty()) {
+                value = next++;
+            } else {
+                value = released.back();
+                released.pop_back();
+            }
+        }
+
+        ~Id() {
+            std::lock_guard lock(mutex);
+            released.push_back(value);
+        }
+    };
+
+    thread_local Id id;
+    return id.value;
+}
+
+// Makes a sequential ordered set safe to share by holding a mutex around
+// every call. The baseline for Concurrent.
+template <class OrderedSet>
+class Locked {
+public:
+    using key_type = typename OrderedSet::key_type;
+    using size_type = typename OrderedSet::size_type;
+
+private:
+    mutable OrderedSet m_set;
+    mutable std::mutex m_mutex;
+
+public:
+    Locked() {}
+
+    bool contains(key_type key) const {
+        std::lock_guard lock(m_mutex);
+        return m_set.contains(key);
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        std::lock_guard lock(m_mutex);
+        return m_set.predecessor(key);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        std::lock_guard lock(m_mutex);
+        return m_set.successor(key);
+    }
+
+    size_type size() const {
+        std::lock_guard lock(m_mutex);
+        return m_set.size();
+    }
+
+    void insert(key_type key) {
+        std::lock_guard lock(m_mutex);
+        m_set.insert(key);
+    }
+
+    void remove(key_type key) {
+        std::lock_guard lock(m_mutex);
+        m_set.remove(key);
+    }
+};
+
+// Makes a sequential ordered set safe to share by flat combining. A thread
+// publishes its operation in its own slot and then tries to take the lock.
+// Whoever gets it becomes the combiner: it collects every pending operation,
+// applies them in key order and hands back the answers, while the others
+// wait on their slots. Contention turns into larger batches, and the set
+// stays in the cache of one core at a time.
+//
+// Threads beyond the slots fall back to taking the lock for themselves.
+template <class OrderedSet, size_t Slots = 128>
+class Concurrent {
+public:
+    using key_type = typename OrderedSet::key_type;
+    using size_type = typename OrderedSet::size_type;
+
+    // A combiner makes up to this many passes over the slots while new
+    // operations keep arriving.
+    static constexpr size_type PASSES = 4;
+
+    // Waiters spin this many times between yields.
+    static constexpr size_type SPINS = 64;
+
+private:
+    enum State : uint32_t {
+        Empty,
+        Pending,
+        Done
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> state = State::Empty;
+        Op op;
+        key_type key;
+        std::optional<key_type> answer;
+    };
+
+    mutable OrderedSet m_set;
+    mutable std::atomic<bool> m_locked;
+    mutable std::array<Slot, Slots> m_slots;
+
+    // One past the highest slot that has been used.
+    mutable std::atomic<size_type> m_used;
+
+    // Reads before trying, so that waiters spin on a shared cache line.
+    bool try_lock() const {
+        return !m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire);
+    }
+
+    void lock() const {
+        for (size_type spins = 1; !try_lock(); ++spins) {
+            if (spins % SPINS == 0) std::this_thread::yield();
+        }
+    }
+
+    void unlock() const {
+        m_locked.store(false, std::memory_order_release);
+    }
+
+    // Applies the pending operations of one pass, and returns how many
+    // there were.
+    size_type combine_pass(std::vector<size_type>& pending) const {
+        pending.clear();
+        const auto used = m_used.load(std::memory_order_acquire);
+        for (size_type i = 0; i < used; ++i) {
+            if (m_slots[i].state.load(std::memory_order_acquire) == State::Pending) {
+                pending.push_back(i);
+            }
+        }
+
+        // Requests that are pending together are concurrent, so any order
+        // is a valid one.
+        std::sort(pending.begin(), pending.end(), [this](size_type a, size_type b) {
+            return m_slots[a].key < m_slots[b].key;
+        });
+        for (const auto i : pending) {
+            auto& slot = m_slots[i];
+            slot.answer = apply(m_set, slot.op, slot.key);
+            slot.state.store(State::Done, std::memory_order_release);
+        }
+        return pending.size();
+    }
+
+    void combine() const {
+        thread_local std::vector<size_type> pending;
+        for (size_type pass = 0; pass < PASSES && combine_pass(pending) > 0; ++pass) {}
+    }
+
+    std::optional<key_type> run(Op op, key_type key) const {
+        const auto id = thread_slot();
+        if (id >= Slots) {
+            lock();
+            auto answer = apply(m_set, op, key);
+            unlock();
+            return answer;
+        }
+
+        auto used = m_used.load(std::memory_order_relaxed);
+        while (used <= id && !m_used.compare_exchange_weak(used, id + 1)) {}
+
+        auto& slot = m_slots[id];
+        slot.op = op;
+        slot.key = key;
+        slot.state.store(State::Pending, std::memory_order_release);
+
+        for (size_type spins = 0; slot.state.load(std::memory_order_acquire) != State::Done; ++spins) {
+            if (try_lock()) {
+                combine();
+                unlock();
+            } else if (spins % SPINS == SPINS - 1) {
+                std::this_thread::yield();
+            }
+        }
+
+        auto answer = slot.answer;
+        slot.state.store(State::Empty, std::memory_order_relaxed);
+        return answer;
+    }
+
+public:
+    Concurrent() : m_locked(false), m_used(0) {}
+
+    Concurrent(const Concurrent&) = delete;
+    Concurrent& operator=(const Concurrent&) = delete;
+
+    bool contains(key_type key) const {
+        return run(Op::Contains, key).has_value();
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        return run(Op::Predecessor, key);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        return run(Op::Successor, key);
+    }
+
+    size_type size() const {
+        lock();
+        auto size = m_set.size();
+        unlock();
+        return size;
+    }
+
+    void insert(key_type key) {
+        run(Op::Insert, key);
+    }
+
+    void remove(key_type key) {
+        run(Op::Remove, key);
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <vector>
+
+#include "sorted_keys.hpp"
+
+// A read-only ordered set of Elias-Fano encoded keys. Each key is split into
+// its low L bits, about log(U / n) for n keys up to U, stored packed, and its
+// high bits, stored in unary: the i-th key sets bit high + i of the upper
+// bit vector, so each run of ones is a bucket of keys sharing their high
+// bits and each zero ends a bucket. That is about 2 + log(U / n) bits per
+// key. Samples of every SAMPLE-th one and zero jump close to a select, which
+// finds a key by index or a bucket by its high bits.
+class EliasFano {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr size_type SAMPLE = 256;
+
+private:
+    size_type m_size;
+    size_type m_low_bits;
+    key_type m_max_high;
+    std::vector<uint64_t> m_low;
+    std::vector<uint64_t> m_upper;
+
+    // The positions of one and zero number j * SAMPLE in m_upper.
+    std::vector<size_type> m_ones;
+    std::vector<size_type> m_zeros;
+
+    key_type low(size_type i) const {
+        if (m_low_bits == 0) return 0;
+        const auto bit = i * m_low_bits;
+        const auto word = bit / 64;
+        const auto offset = bit % 64;
+        auto value = m_low[word] >> offset;
+        if (offset + m_low_bits > 64) value |= m_low[word+1] << (64 - offset);
+        return value & ((key_type(1) << m_low_bits) - 1);
+    }
+
+    // The position of the k-th set bit among the words, counting from zero,
+    // scanning from a sampled position.
+    template <bool One>
+    static size_type select(const std::vector<uint64_t>& words, const std::vector<size_type>& samples, size_type k) {
+        const auto start = samples[k / SAMPLE];
+        auto word = start / 64;
+        auto bits = (One ? words[word] : ~words[word]) & (~uint64_t(0) << (start % 64));
+        auto rest = k % SAMPLE;
+        for (auto count = size_type(std::popcount(bits)); rest >= count; count = std::popcount(bits)) {
+            rest -= count;
+            ++word;
+            bits = One ? words[word] : ~words[word];
+        }
+        for (; rest > 0; --rest) {
+            bits &= bits - 1;
+        }
+        return 64 * word + std::countr_zero(bits);
+    }
+
+    size_type select1(size_type k) const {
+        return select<true>(m_upper, m_ones, k);
+    }
+
+    size_type select0(size_type k) const {
+        return select<false>(m_upper, m_zeros, k);
+    }
+
+    // The key at the index whose one is at the position.
+    key_type key(size_type i, size_type position) const {
+        return (key_type(position - i) << m_low_bits) | low(i);
+    }
+
+    // The index of the first key not less than x: the bucket of x's high
+    // bits is found by select, and its low bits searched.
+    size_type lower_bound(key_type x) const {
+        const auto high = x >> m_low_bits;
+        if (m_size == 0 || high > m_max_high) return m_size;
+
+        auto lo = high == 0 ? 0 : select0(high - 1) - (high - 1);
+        auto hi = select0(high) - high;
+        const auto x_low = x & ((key_type(1) << m_low_bits) - 1);
+        while (lo < hi) {
+            const auto mid = (lo + hi) / 2;
+            if (low(mid) < x_low) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+public:
+    class const_iterator {
+        friend class EliasFano;
+
+        const EliasFano* m_set;
+        size_type m_index;
+        size_type m_position;
+
+        const_iterator(const EliasFano* set, size_type index, size_type position)
+            : m_set(set), m_index(index), m_position(position) {}
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = key_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const key_type*;
+        using reference = key_type;
+
+        const_iterator() : m_set(nullptr), m_index(0), m_position(0) {}
+
+        key_type operator*() const {
+            return m_set->key(m_index, m_position);
+        }
+
+        // Moves on to the next one in the upper bits.
+        const_iterator& operator++() {
+            if (++m_index == m_set->m_size) return *this;
+            auto word = (m_position + 1) / 64;
+            auto bits = m_set->m_upper[word] & (~uint64_t(0) << ((m_position + 1) % 64));
+            while (bits == 0) {
+                bits = m_set->m_upper[++word];
+            }
+            m_position = 64 * word + std::countr_zero(bits);
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            auto it = *this;
+            ++*this;
+            return it;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return m_index == other.m_index;
+        }
+    };
+
+    // Builds the set from keys in strictly increasing order.
+    EliasFano(const std::vector<key_type>& keys) : m_size(keys.size()), m_low_bits(0), m_max_high(0) {
+        if (keys.empty()) return;
+
+        const auto universe = keys.back() / m_size;
+        if (universe > 0) m_low_bits = std::bit_width(universe) - 1;
+        m_max_high = keys.back() >> m_low_bits;
+
+        m_low.assign((m_size * m_low_bits + 63) / 64 + 1, 0);
+        m_upper.assign((m_size + m_max_high + 1) / 64 + 1, 0);
+        for (size_type i = 0; i < m_size; ++i) {
+            const auto bit = i * m_low_bits;
+            const auto low = keys[i] & ((key_type(1) << m_low_bits) - 1);
+            if (m_low_bits > 0) {
+                m_low[bit / 64] |= low << (bit % 64);
+                if (bit % 64 + m_low_bits > 64) m_low[bit / 64 + 1] |= low >> (64 - bit % 64);
+            }
+
+            const auto position = (keys[i] >> m_low_bits) + i;
+            m_upper[position / 64] |= uint64_t(1) << (position % 64);
+        }
+
+        size_type ones = 0;
+        size_type zeros = 0;
+        for (size_type position = 0; position < m_size + m_max_high + 1; ++position) {
+            if (m_upper[position / 64] >> (position % 64) & 1) {
+                if (ones++ % SAMPLE == 0) m_ones.push_back(position);
+            } else {
+                if (zeros++ % SAMPLE == 0) m_zeros.push_back(position);
+            }
+        }
+    }
+
+    template <class OrderedSet>
+    static EliasFano from(const OrderedSet& set) {
+        return EliasFano(sorted_keys(set));
+    }
+
+    const_iterator begin() const {
+        return m_size == 0 ? end() : const_iterator(this, 0, select1(0));
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, m_size, 0);
+    }
+
+    bool contains(key_type key) const {
+        const auto i = lower_bound(key);
+        return i < m_size && select(i) == key;
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        const auto i = lower_bound(key);
+        if (i == 0) return std::nullopt;
+        return select(i - 1);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        auto i = lower_bound(key);
+        if (i < m_size && select(i) == key) ++i;
+        if (i == m_size) return std::nullopt;
+        return select(i);
+    }
+
+    size_type size() const {
+        return m_size;
+    }
+
+    // The number of keys less than the key.
+    size_type rank(key_type key) const {
+        return lower_bound(key);
+    }
+
+    // The k-th smallest key, counting from zero, which must exist.
+    key_type select(size_type k) const {
+        return key(k, select1(k));
+    }
+
+    size_type memory() const {
+        return (m_low.size() + m_upper.size()) * sizeof(uint64_t)
+            + (m_ones.size() + m_zeros.size()) * sizeof(size_type);
+    }
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+
+#include "bloom_filter.hpp"
+#include "sorted_keys.hpp"
+
+// Puts a counting Bloom filter in front of contains(), so that most lookups
+// of absent keys are answered without touching the inner set. The filter
+// follows the inner set's size to tell real updates from no-ops, and is
+// rebuilt twice as large whenever the set outgrows its capacity.
+template <class OrderedSet>
+class FilteredOrderedSet {
+public:
+    using key_type = typename OrderedSet::key_type;
+    using size_type = typename OrderedSet::size_type;
+
+    static constexpr size_type DEFAULT_CAPACITY = 1 << 8;
+    static constexpr size_type DEFAULT_COUNTERS_PER_KEY = 16;
+    static constexpr size_type DEFAULT_HASHES = 8;
+
+private:
+    OrderedSet m_set;
+    CountingBloomFilter m_filter;
+    size_type m_capacity;
+    size_type m_counters_per_key;
+    size_type m_hashes;
+
+    void grow() {
+        m_capacity *= 2;
+        m_filter = CountingBloomFilter(m_capacity, m_counters_per_key, m_hashes);
+        for (const auto key : sorted_keys(m_set)) {
+            m_filter.insert(key);
+        }
+    }
+
+public:
+    // More counters per key lower the false positive rate, which is lowest
+    // at about 0.7 hashes per counter per key.
+    FilteredOrderedSet(
+        size_type capacity = DEFAULT_CAPACITY,
+        size_type counters_per_key = DEFAULT_COUNTERS_PER_KEY,
+        size_type hashes = DEFAULT_HASHES
+    ) : m_filter(capacity, counters_per_key, hashes),
+        m_capacity(capacity), m_counters_per_key(counters_per_key), m_hashes(hashes) {}
+
+    bool contains(key_type key) const {
+        return m_filter.may_contain(key) && m_set.contains(key);
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        return m_set.predecessor(key);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        return m_set.successor(key);
+    }
+
+    size_type size() const {
+        return m_set.size();
+    }
+
+    void insert(key_type key) {
+        const auto size = m_set.size();
+        m_set.insert(key);
+        if (m_set.size() == size) return;
+
+        if (m_set.size() > m_capacity) {
+            grow();
+        } else {
+            m_filter.insert(key);
+        }
+    }
+
+    void remove(key_type key) {
+        const auto size = m_set.size();
+        m_set.remove(key);
+        if (m_set.size() != size) {
+            m_filter.remove(key);
+        }
+    }
+
+    const OrderedSet& set() const {
+        return m_set;
+    }
+
+    const CountingBloomFilter& filter() const {
+        return m_filter;
+    }
+};
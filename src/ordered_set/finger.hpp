@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+// A path from the root of a tree down to the last node an operation touched.
+// The next operation walks up the path only until it reaches a subtree that
+// can hold its key, so runs of nearby keys skip most of the descent.
+//
+// Any update that does not go through the finger may free nodes on the path,
+// so trees only trust a finger taken at their current version.
+template <class Node, class Key, size_t Depth>
+struct Finger {
+    struct Entry {
+        Node* node;
+
+        // The child taken to reach the next entry.
+        size_t index;
+
+        // The open range of keys the subtree can hold.
+        Key lo;
+        Key hi;
+        bool has_lo;
+        bool has_hi;
+
+        bool holds(Key key) const {
+            return (!has_lo || lo < key) && (!has_hi || key < hi);
+        }
+    };
+
+    std::array<Entry, Depth> path;
+    size_t depth = 0;
+
+    const void* owner = nullptr;
+    size_t version = 0;
+};
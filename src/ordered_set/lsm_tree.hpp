@@ -0,0 +1,412 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "b_tree.hpp"
+#include "sorted_keys.hpp"
+
+// A log-structured merge tree. Updates go to a small mutable memtable, which
+// is frozen into an immutable sorted run once it holds Capacity keys. A
+// background thread does tiered compaction: a run that has grown to within
+// RATIO times the size of the older runs behind it is merged with them into
+// one, so the run sizes grow geometrically and every key is rewritten about
+// once per tier.
+//
+// Removes are tombstones that shadow older runs until a merge reaches the
+// oldest run, which is when they are dropped. The tree itself is not safe
+// to share between threads; the compaction thread only swaps runs.
+template <class Memtable = BTree, size_t Capacity = 1 << 12>
+class LsmTree {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr size_type RATIO = 4;
+
+    // Writers wait for compaction when this many runs are pending.
+    static constexpr size_type MAX_RUNS = 32;
+
+    // Keys per fence pointer.
+    static constexpr size_type FENCE = 64;
+
+    // Runs up to this many times larger than a sorted batch of lookups are
+    // walked alongside it rather than searched.
+    static constexpr size_type WALK = 64;
+
+private:
+    // An immutable sorted run with a fence pointer per block of keys.
+    struct Run {
+        std::vector<key_type> keys;
+        std::vector<uint8_t> live;
+        std::vector<key_type> fences;
+
+        Run(std::vector<key_type> keys, std::vector<uint8_t> live)
+            : keys(std::move(keys)), live(std::move(live)) {
+            for (size_type i = 0; i < this->keys.size(); i += FENCE) {
+                fences.push_back(this->keys[i]);
+            }
+        }
+
+        size_type size() const {
+            return keys.size();
+        }
+
+        // The index of the first key not less than the key, found in the
+        // block before the first fence greater than the key.
+        size_type search(key_type key, size_type block) const {
+            if (block == 0) return 0;
+
+            auto first = keys.begin() + (block - 1) * FENCE;
+            auto last = keys.begin() + std::min(block * FENCE, keys.size());
+            return std::lower_bound(first, last, key) - keys.begin();
+        }
+
+        // The index of the first key not less than the key.
+        size_type lower_bound(key_type key) const {
+            return search(key, std::upper_bound(fences.begin(), fences.end(), key) - fences.begin());
+        }
+
+        // The same, for a key not less than the last one looked up with
+        // this hint. The fences are searched by galloping up from the
+        // hint, so a sorted batch of lookups takes a short search each.
+        size_type lower_bound(key_type key, size_type& hint) const {
+            auto lo = hint;
+            auto hi = hint;
+            for (size_type step = 1; hi < fences.size() && fences[hi] <= key; step *= 2) {
+                lo = hi + 1;
+                hi += step;
+            }
+            hi = std::min(hi, fences.size());
+            hint = std::upper_bound(fences.begin() + lo, fences.begin() + hi, key) - fences.begin();
+            return search(key, hint);
+        }
+
+        // The index of the first key greater than the key.
+        size_type upper_bound(key_type key) const {
+            auto i = lower_bound(key);
+            return i + (i < keys.size() && keys[i] == key);
+        }
+    };
+
+    using RunPtr = std::shared_ptr<const Run>;
+
+    // The keys inserted and removed since the last freeze. They never
+    // share a key.
+    Memtable m_puts;
+    Memtable m_dels;
+
+    // Newest first, guarded by the mutex.
+    std::vector<RunPtr> m_runs;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work;
+    std::condition_variable m_space;
+    bool m_stop;
+
+    // The live keys in the runs. Writes are blind, so each frozen memtable
+    // is counted against the runs once, as it becomes a run; merges never
+    // change what is live.
+    size_type m_size;
+
+    std::thread m_compactor;
+
+    // Whether the key is live in the runs, where the newest run with the key
+    // decides.
+    static bool live(const std::vector<RunPtr>& runs, key_type key) {
+        for (const auto& run : runs) {
+            auto i = run->lower_bound(key);
+            if (i < run->size() && run->keys[i] == key) {
+                return run->live[i];
+            }
+        }
+        return false;
+    }
+
+    // The number of sorted keys that are live in the runs. Each run is only
+    // searched for the keys that newer runs do not have, in order.
+    static size_type live(const std::vector<RunPtr>& runs, const std::vector<key_type>& keys) {
+        std::vector<uint8_t> found(keys.size(), false);
+        size_type count = 0;
+        for (const auto& run : runs) {
+            const auto walk = run->size() <= WALK * keys.size();
+            size_type i = 0;
+            size_type hint = 0;
+            for (size_type k = 0; k < keys.size(); ++k) {
+                if (found[k]) continue;
+                if (walk) {
+                    while (i < run->size() && run->keys[i] < keys[k]) ++i;
+                } else {
+                    i = run->lower_bound(keys[k], hint);
+                }
+                if (i < run->size() && run->keys[i] == keys[k]) {
+                    found[k] = true;
+                    count += run->live[i];
+                }
+            }
+        }
+        return count;
+    }
+
+    // The keys that sorted puts and removes would add to and take from the
+    // live keys in the runs.
+    static std::pair<size_type, size_type> changes(const std::vector<RunPtr>& runs, const std::vector<key_type>& puts, const std::vector<key_type>& dels) {
+        return {puts.size() - live(runs, puts), live(runs, dels)};
+    }
+
+    std::vector<RunPtr> snapshot() const {
+        std::lock_guard lock(m_mutex);
+        return m_runs;
+    }
+
+    // Merges runs, newest first, where a newer key shadows an older one.
+    static RunPtr merge(const std::vector<RunPtr>& runs, bool oldest) {
+        size_type total = 0;
+        for (const auto& run : runs) {
+            total += run->size();
+        }
+
+        std::vector<key_type> keys;
+        std::vector<uint8_t> live;
+        keys.reserve(total);
+        live.reserve(total);
+
+        std::vector<size_type> next(runs.size(), 0);
+        while (true) {
+            // Find the smallest key and the newest run that has it.
+            std::optional<key_type> key;
+            size_type newest = 0;
+            for (size_type r = 0; r < runs.size(); ++r) {
+                if (next[r] == runs[r]->size()) continue;
+                if (!key.has_value() || runs[r]->keys[next[r]] < *key) {
+                    key = runs[r]->keys[next[r]];
+                    newest = r;
+                }
+            }
+            if (!key.has_value()) break;
+
+            // Nothing older is left for a tombstone to shadow.
+            auto alive = runs[newest]->live[next[newest]];
+            if (alive || !oldest) {
+                keys.push_back(*key);
+                live.push_back(alive);
+            }
+
+            for (size_type r = 0; r < runs.size(); ++r) {
+                if (next[r] < runs[r]->size() && runs[r]->keys[next[r]] == *key) ++next[r];
+            }
+        }
+
+        return std::make_shared<const Run>(std::move(keys), std::move(live));
+    }
+
+    // Picks the newest run that is at least 1/RATIO of its older neighbour,
+    // together with the older runs the merged run keeps catching up with.
+    // Returns an empty range if no merge is due.
+    std::pair<size_type, size_type> pick() const {
+        for (size_type i = 0; i + 1 < m_runs.size(); ++i) {
+            auto total = m_runs[i]->size();
+            auto j = i;
+            while (j + 1 < m_runs.size() && total * RATIO >= m_runs[j+1]->size()) {
+                total += m_runs[++j]->size();
+            }
+            if (j > i) return {i, j + 1};
+        }
+        return {0, 0};
+    }
+
+    void compact() {
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            m_work.wait(lock, [this]() { return m_stop || pick().second > 0; });
+            if (m_stop) return;
+
+            // Runs are only ever added in front, so the picked runs stay
+            // where they are relative to the end while merging unlocked.
+            auto [first, last] = pick();
+            std::vector<RunPtr> runs(m_runs.begin() + first, m_runs.begin() + last);
+            auto oldest = last == m_runs.size();
+            auto from_end = m_runs.size() - last;
+
+            lock.unlock();
+            auto merged = merge(runs, oldest);
+            lock.lock();
+
+            last = m_runs.size() - from_end;
+            first = last - runs.size();
+            m_runs.erase(m_runs.begin() + first + 1, m_runs.begin() + last);
+            m_runs[first] = std::move(merged);
+            m_space.notify_all();
+        }
+    }
+
+    // Turns the memtables into a new run. Only this thread adds runs and
+    // merges keep what is live, so the runs counted against here answer
+    // like the ones the new run goes in front of.
+    void freeze() {
+        auto puts = sorted_keys(m_puts);
+        auto dels = sorted_keys(m_dels);
+
+        const auto [added, removed] = changes(snapshot(), puts, dels);
+        m_size = m_size + added - removed;
+
+        std::vector<key_type> keys;
+        std::vector<uint8_t> live;
+        keys.reserve(puts.size() + dels.size());
+        live.reserve(puts.size() + dels.size());
+
+        size_type i = 0;
+        size_type j = 0;
+        while (i < puts.size() || j < dels.size()) {
+            if (j == dels.size() || (i < puts.size() && puts[i] < dels[j])) {
+                keys.push_back(puts[i++]);
+                live.push_back(true);
+            } else {
+                keys.push_back(dels[j++]);
+                live.push_back(false);
+            }
+        }
+
+        m_puts = Memtable();
+        m_dels = Memtable();
+
+        auto run = std::make_shared<const Run>(std::move(keys), std::move(live));
+        std::unique_lock lock(m_mutex);
+        m_space.wait(lock, [this]() { return m_runs.size() < MAX_RUNS; });
+        m_runs.insert(m_runs.begin(), std::move(run));
+        m_work.notify_one();
+    }
+
+    void maybe_freeze() {
+        if (m_puts.size() + m_dels.size() >= Capacity) {
+            freeze();
+        }
+    }
+
+public:
+    LsmTree() : m_stop(false), m_size(0), m_compactor([this]() { compact(); }) {}
+
+    LsmTree(const LsmTree&) = delete;
+    LsmTree& operator=(const LsmTree&) = delete;
+
+    ~LsmTree() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_work.notify_one();
+        m_compactor.join();
+    }
+
+    bool contains(key_type key) const {
+        if (m_puts.contains(key)) return true;
+        if (m_dels.contains(key)) return false;
+
+        std::lock_guard lock(m_mutex);
+        return live(m_runs, key);
+    }
+
+    // Walks the keys of every source downwards from the key at once, until
+    // the newest source for one of them says it is live.
+    std::optional<key_type> predecessor(key_type key) const {
+        std::lock_guard lock(m_mutex);
+
+        auto put = m_puts.predecessor(key);
+        auto del = m_dels.predecessor(key);
+        std::array<size_type, MAX_RUNS> ends;
+        for (size_type r = 0; r < m_runs.size(); ++r) {
+            ends[r] = m_runs[r]->lower_bound(key);
+        }
+
+        while (true) {
+            std::optional<key_type> pred = put;
+            if (del.has_value() && (!pred.has_value() || *pred < *del)) pred = del;
+            for (size_type r = 0; r < m_runs.size(); ++r) {
+                if (ends[r] > 0 && (!pred.has_value() || *pred < m_runs[r]->keys[ends[r]-1])) {
+                    pred = m_runs[r]->keys[ends[r]-1];
+                }
+            }
+            if (!pred.has_value() || pred == put) return pred;
+
+            bool live = false;
+            bool found = pred == del;
+            for (size_type r = 0; r < m_runs.size(); ++r) {
+                if (ends[r] > 0 && m_runs[r]->keys[ends[r]-1] == *pred) {
+                    if (!found) live = m_runs[r]->live[ends[r]-1];
+                    found = true;
+                    --ends[r];
+                }
+            }
+            if (live) return pred;
+
+            if (pred == del) del = m_dels.predecessor(*pred);
+        }
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        std::lock_guard lock(m_mutex);
+
+        auto put = m_puts.successor(key);
+        auto del = m_dels.successor(key);
+        std::array<size_type, MAX_RUNS> begins;
+        for (size_type r = 0; r < m_runs.size(); ++r) {
+            begins[r] = m_runs[r]->upper_bound(key);
+        }
+
+        while (true) {
+            std::optional<key_type> succ = put;
+            if (del.has_value() && (!succ.has_value() || *del < *succ)) succ = del;
+            for (size_type r = 0; r < m_runs.size(); ++r) {
+                if (begins[r] < m_runs[r]->size() && (!succ.has_value() || m_runs[r]->keys[begins[r]] < *succ)) {
+                    succ = m_runs[r]->keys[begins[r]];
+                }
+            }
+            if (!succ.has_value() || succ == put) return succ;
+
+            bool live = false;
+            bool found = succ == del;
+            for (size_type r = 0; r < m_runs.size(); ++r) {
+                if (begins[r] < m_runs[r]->size() && m_runs[r]->keys[begins[r]] == *succ) {
+                    if (!found) live = m_runs[r]->live[begins[r]];
+                    found = true;
+                    ++begins[r];
+                }
+            }
+            if (live) return succ;
+
+            if (succ == del) del = m_dels.successor(*succ);
+        }
+    }
+
+    // Counts the memtable against the runs, which takes a lookup for each
+    // of the at most Capacity keys in it.
+    size_type size() const {
+        const auto [added, removed] = changes(snapshot(), sorted_keys(m_puts), sorted_keys(m_dels));
+        return m_size + added - removed;
+    }
+
+    void insert(key_type key) {
+        m_dels.remove(key);
+        m_puts.insert(key);
+        maybe_freeze();
+    }
+
+    void remove(key_type key) {
+        m_puts.remove(key);
+        m_dels.insert(key);
+        maybe_freeze();
+    }
+
+    size_type runs() const {
+        std::lock_guard lock(m_mutex);
+        return m_runs.size();
+    }
+};
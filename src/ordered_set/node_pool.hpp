@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+// How a pool backs its chunks. Huge pages let a large tree be covered by a
+// few TLB entries instead of one for every 4K page its nodes are spread
+// over.
+enum class Pages {
+    Normal,
+    Huge
+};
+
+// Allocates the nodes of one tree from large chunks and recycles freed
+// nodes through a free list. Dropping the pool frees every node at once, so
+// a tree is destroyed without walking it, and moving a tree moves its pool
+// in constant time. A pool is not thread-safe; parallel builds give each
+// thread its own pool and adopt them afterwards.
+//
+// A pool for huge pages rounds its chunks up to whole 2MB pages and maps
+// them from the reserved huge pages if there are any, or else asks for
+// transparent huge pages, and takes ordinary memory if both fail. Every
+// chunk is at least 2MB then, so it only pays off for large trees.
+template <class Node>
+class NodePool {
+    static_assert(std::is_trivially_destructible_v<Node>, "nodes are freed without running destructors");
+
+public:
+    using size_type = size_t;
+
+    // Chunks double in size between these bounds. The first is small, since
+    // many trees only ever hold a few keys.
+    static constexpr size_type MIN_CHUNK = 4;
+    static constexpr size_type MAX_CHUNK = 1 << 16;
+
+    static constexpr size_type HUGE_PAGE = size_type(2) << 20;
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(Node) std::byte node[sizeof(Node)];
+    };
+
+    // The bytes mapped for the chunk, or zero if it came from operator new.
+    struct Chunk {
+        Slot* slots;
+        size_type count;
+        size_type mapped;
+    };
+
+    Pages m_pages = Pages::Normal;
+    std::vector<Chunk> m_chunks;
+    size_type m_capacity = 0;
+
+    // Freed slots, then the untouched rest of the last chunk, then the
+    // untouched rest of earlier and adopted chunks. Untouched slots are
+    // never written before they are handed out, so memory that is mapped
+    // but unused stays unfaulted.
+    Slot* m_free = nullptr;
+    Slot* m_next = nullptr;
+    Slot* m_end = nullptr;
+    std::vector<std::pair<Slot*, Slot*>> m_spare;
+
+    // Maps whole huge pages for at least the bytes, or returns null. A
+    // mapping for transparent huge pages is aligned to a huge page by hand,
+    // since the kernel only backs aligned ranges with them.
+    static void* map_huge(size_type bytes) {
+#ifdef MAP_HUGETLB
+        auto memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) return memory;
+#endif
+        memory = mmap(nullptr, bytes + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) return nullptr;
+
+        auto begin = reinterpret_cast<uintptr_t>(memory);
+        auto aligned = (begin + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+        if (aligned > begin) munmap(memory, aligned - begin);
+        munmap(reinterpret_cast<void*>(aligned + bytes), begin + HUGE_PAGE - aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(reinterpret_cast<void*>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    void allocate(size_type count) {
+        Slot* slots = nullptr;
+        size_type mapped = 0;
+        if (m_pages == Pages::Huge) {
+            mapped = (count * sizeof(Slot) + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+            slots = static_cast<Slot*>(map_huge(mapped));
+            if (slots != nullptr) {
+                count = mapped / sizeof(Slot);
+            } else {
+                mapped = 0;
+            }
+        }
+        if (slots == nullptr) {
+            slots = static_cast<Slot*>(::operator new(count * sizeof(Slot), std::align_val_t(alignof(Slot))));
+        }
+        m_chunks.push_back({slots, count, mapped});
+        m_capacity += count;
+        if (m_next != m_end) m_spare.emplace_back(m_next, m_end);
+        m_next = slots;
+        m_end = slots + count;
+    }
+
+    void release() {
+        for (const auto& chunk : m_chunks) {
+            if (chunk.mapped > 0) {
+                munmap(chunk.slots, chunk.mapped);
+            } else {
+                ::operator delete(chunk.slots, chunk.count * sizeof(Slot), std::align_val_t(alignof(Slot)));
+            }
+        }
+        m_chunks.clear();
+        m_spare.clear();
+        m_capacity = 0;
+        m_free = m_next = m_end = nullptr;
+    }
+
+public:
+    NodePool() = default;
+
+    explicit NodePool(Pages pages) : m_pages(pages) {}
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    NodePool(NodePool&& other) noexcept {
+        swap(other);
+    }
+
+    NodePool& operator=(NodePool&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~NodePool() {
+        release();
+    }
+
+    template <class... Args>
+    Node* create(Args&&... args) {
+        Slot* slot;
+        if (m_free != nullptr) {
+            slot = m_free;
+            m_free = slot->next;
+        } else {
+            if (m_next == m_end && !m_spare.empty()) {
+                std::tie(m_next, m_end) = m_spare.back();
+                m_spare.pop_back();
+            }
+            if (m_next == m_end) {
+                allocate(std::clamp(m_capacity, MIN_CHUNK, MAX_CHUNK));
+            }
+            slot = m_next++;
+        }
+        return new (slot->node) Node(std::forward<Args>(args)...);
+    }
+
+    void destroy(Node* node) {
+        node->~Node();
+        auto slot = reinterpret_cast<Slot*>(node);
+        slot->next = m_free;
+        m_free = slot;
+    }
+
+    // Makes the next count nodes that are not recycled come from a single
+    // contiguous chunk, in the order they are created.
+    void reserve(size_type count) {
+        if (static_cast<size_type>(m_end - m_next) < count) {
+            allocate(count);
+        }
+    }
+
+    // Takes over the nodes of another pool, along with its unused slots.
+    void adopt(NodePool&& other) {
+        if (other.m_next != other.m_end) m_spare.emplace_back(other.m_next, other.m_end);
+        m_spare.insert(m_spare.end(), other.m_spare.begin(), other.m_spare.end());
+        while (other.m_free != nullptr) {
+            auto slot = other.m_free;
+            other.m_free = slot->next;
+            slot->next = m_free;
+            m_free = slot;
+        }
+
+        m_chunks.insert(m_chunks.end(), other.m_chunks.begin(), other.m_chunks.end());
+        m_capacity += other.m_capacity;
+        other.m_chunks.clear();
+        other.m_spare.clear();
+        other.m_capacity = 0;
+        other.m_next = other.m_end = nullptr;
+    }
+
+    void swap(NodePool& other) noexcept {
+        std::swap(m_pages, other.m_pages);
+        std::swap(m_chunks, other.m_chunks);
+        std::swap(m_capacity, other.m_capacity);
+        std::swap(m_free, other.m_free);
+        std::swap(m_next, other.m_next);
+        std::swap(m_end, other.m_end);
+        std::swap(m_spare, other.m_spare);
+    }
+
+    Pages pages() const {
+        return m_pages;
+    }
+
+    // The bytes held by the pool, in use or not.
+    size_type memory() const {
+        return m_capacity * sizeof(Slot);
+    }
+};
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "buffer_pool.hpp"
+
+// A B-tree for sets larger than memory. Every node is a page of a file on
+// local disk, and only as many pages as fit the memory budget are held at a
+// time, in a BufferPool. The node count and root live in memory, so the
+// file is scratch space rather than a saved set.
+//
+// Updates go top-down in a single pass: full nodes are split on the way
+// down to an insert, and nodes with the minimum number of keys are topped
+// up from a sibling or merged on the way down to a remove. Nothing above
+// the current node is touched again, so no more than five pages are ever
+// pinned at once.
+template <size_t PageSize = 4096>
+class PagedBTree {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    // The default memory budget, and the directory the page file goes in
+    // unless TMPDIR says otherwise.
+    static constexpr size_type DEFAULT_BUDGET = 64 << 20;
+    static constexpr const char* DEFAULT_DIRECTORY = "/tmp";
+
+    // A range scan asks for up to this many of the next children of a node
+    // to be read ahead.
+    static constexpr size_type PREFETCH = 8;
+
+private:
+    using Pool = BufferPool<PageSize>;
+    using page_id = typename Pool::page_id;
+
+    // Enough for the pages an update pins at once.
+    static constexpr size_type MIN_FRAMES = 8;
+
+    // The page header holds the size and whether the node is a leaf, and
+    // the rest holds an odd number of keys and one child more.
+    static constexpr size_type MAX_KEYS = PageSize / 16 - 1;
+    static constexpr size_type MIN_KEYS = (MAX_KEYS - 1) / 2;
+
+    static_assert(MAX_KEYS >= 3 && MAX_KEYS % 2 == 1, "pages must hold at least three keys");
+
+    struct Node {
+        uint32_t size;
+        uint32_t leaf;
+        std::array<key_type, MAX_KEYS> keys;
+        std::array<page_id, MAX_KEYS + 1> children;
+
+        size_type lower_bound(key_type key) const {
+            return std::lower_bound(keys.begin(), keys.begin() + size, key) - keys.begin();
+        }
+
+        size_type upper_bound(key_type key) const {
+            return std::upper_bound(keys.begin(), keys.begin() + size, key) - keys.begin();
+        }
+
+        bool full() const {
+            return size == MAX_KEYS;
+        }
+    };
+
+    static_assert(sizeof(Node) <= PageSize);
+
+    // A page pinned for as long as the handle lives. Changes go through
+    // edit(), which marks the page dirty.
+    class Page {
+        Pool* m_pool;
+        page_id m_id;
+        Node* m_node;
+        bool m_dirty;
+
+    public:
+        Page(Pool& pool, page_id id, bool fresh = false)
+            : m_pool(&pool), m_id(id),
+              m_node(reinterpret_cast<Node*>(fresh ? pool.pin_new(id) : pool.pin(id))),
+              m_dirty(fresh) {}
+
+        Page(const Page&) = delete;
+        Page& operator=(const Page&) = delete;
+
+        Page(Page&& other) noexcept : m_pool(other.m_pool), m_id(other.m_id), m_node(other.m_node), m_dirty(other.m_dirty) {
+            other.m_pool = nullptr;
+        }
+
+        Page& operator=(Page&& other) noexcept {
+            std::swap(m_pool, other.m_pool);
+            std::swap(m_id, other.m_id);
+            std::swap(m_node, other.m_node);
+            std::swap(m_dirty, other.m_dirty);
+            return *this;
+        }
+
+        ~Page() {
+            release();
+        }
+
+        page_id id() const {
+            return m_id;
+        }
+
+        // Unpins the page before the handle goes away.
+        void release() {
+            if (m_pool != nullptr) m_pool->unpin(m_id, m_dirty);
+            m_pool = nullptr;
+        }
+
+        const Node* operator->() const {
+            return m_node;
+        }
+
+        Node& edit() {
+            m_dirty = true;
+            return *m_node;
+        }
+    };
+
+    mutable Pool m_pool;
+    page_id m_root;
+    size_type m_size;
+
+    Page create(bool leaf) {
+        Page page(m_pool, m_pool.allocate(), true);
+        page.edit().leaf = leaf;
+        return page;
+    }
+
+    // Splits the full child at index i of the parent around its middle key,
+    // which moves up into the parent.
+    void split(Page& parent, size_type i, Page& child) {
+        assert(!parent->full() && child->full());
+        auto sibling = create(child->leaf);
+
+        auto& left = child.edit();
+        auto& right = sibling.edit();
+        right.size = MIN_KEYS;
+        std::copy_n(left.keys.begin() + MIN_KEYS + 1, MIN_KEYS, right.keys.begin());
+        if (!left.leaf) {
+            std::copy_n(left.children.begin() + MIN_KEYS + 1, MIN_KEYS + 1, right.children.begin());
+        }
+        left.size = MIN_KEYS;
+
+        auto& node = parent.edit();
+        std::copy_backward(node.keys.begin() + i, node.keys.begin() + node.size, node.keys.begin() + node.size + 1);
+        std::copy_backward(node.children.begin() + i + 1, node.children.begin() + node.size + 1, node.children.begin() + node.size + 2);
+        node.keys[i] = left.keys[MIN_KEYS];
+        node.children[i+1] = sibling.id();
+        ++node.size;
+    }
+
+    // Moves the separator at index i of the parent and everything in the
+    // right child into the left child, and frees the right child.
+    void merge(Page& parent, size_type i, Page& left, Page right) {
+        assert(left->size + right->size + 1 <= MAX_KEYS);
+        auto& l = left.edit();
+        l.keys[l.size] = parent->keys[i];
+        std::copy_n(right->keys.begin(), right->size, l.keys.begin() + l.size + 1);
+        if (!l.leaf) {
+            std::copy_n(right->children.begin(), right->size + 1, l.children.begin() + l.size + 1);
+        }
+        l.size += right->size + 1;
+
+        auto& node = parent.edit();
+        std::copy(node.keys.begin() + i + 1, node.keys.begin() + node.size, node.keys.begin() + i);
+        std::copy(node.children.begin() + i + 2, node.children.begin() + node.size + 1, node.children.begin() + i + 1);
+        --node.size;
+
+        const auto id = right.id();
+        right.release();
+        m_pool.free(id);
+    }
+
+    // Makes sure the child at index i of the parent has more than the
+    // minimum number of keys, by taking a key through the parent from a
+    // sibling that can spare one, or else by merging with a sibling. Returns
+    // the page now holding the child's keys.
+    Page fill(Page& parent, size_type i) {
+        Page child(m_pool, parent->children[i]);
+        if (child->size > MIN_KEYS) return child;
+
+        if (i > 0) {
+            Page left(m_pool, parent->children[i-1]);
+            if (left->size > MIN_KEYS) {
+                auto& c = child.edit();
+                auto& l = left.edit();
+                std::copy_backward(c.keys.begin(), c.keys.begin() + c.size, c.keys.begin() + c.size + 1);
+                std::copy_backward(c.children.begin(), c.children.begin() + c.size + 1, c.children.begin() + c.size + 2);
+                c.keys[0] = parent->keys[i-1];
+                c.children[0] = l.children[l.size];
+                ++c.size;
+                parent.edit().keys[i-1] = l.keys[l.size - 1];
+                --l.size;
+                return child;
+            }
+            if (i == parent->size) {
+                merge(parent, i - 1, left, std::move(child));
+                return left;
+            }
+        }
+
+        Page right(m_pool, parent->children[i+1]);
+        if (right->size > MIN_KEYS) {
+            auto& c = child.edit();
+            auto& r = right.edit();
+            c.keys[c.size] = parent->keys[i];
+            c.children[c.size + 1] = r.children[0];
+            ++c.size;
+            parent.edit().keys[i] = r.keys[0];
+            std::copy(r.keys.begin() + 1, r.keys.begin() + r.size, r.keys.begin());
+            std::copy(r.children.begin() + 1, r.children.begin() + r.size + 1, r.children.begin());
+            --r.size;
+            return child;
+        }
+
+        merge(parent, i, child, std::move(right));
+        return child;
+    }
+
+    // For the key at index i of the parent, replaces it by its predecessor
+    // or successor from a child that can spare a key, which is then the key
+    // to remove, or else merges the children around it. Returns the child
+    // the key to remove is now under.
+    Page replace(Page& parent, size_type i, key_type& key) {
+        Page left(m_pool, parent->children[i]);
+        if (left->size > MIN_KEYS) {
+            key = extreme<false>(left.id());
+            parent.edit().keys[i] = key;
+            return left;
+        }
+
+        Page right(m_pool, parent->children[i+1]);
+        if (right->size > MIN_KEYS) {
+            key = extreme<true>(right.id());
+            parent.edit().keys[i] = key;
+            return right;
+        }
+
+        merge(parent, i, left, std::move(right));
+        return left;
+    }
+
+    // The largest key under the page, or the smallest if Min.
+    template <bool Min>
+    key_type extreme(page_id id) const {
+        Page page(m_pool, id);
+        while (!page->leaf) {
+            page = Page(m_pool, page->children[Min ? 0 : page->size]);
+        }
+        return page->keys[Min ? 0 : page->size - 1];
+    }
+
+    // Calls visit on the keys in [lo, hi) under the page in order, reading
+    // ahead the children it is about to descend into.
+    template <class Visit>
+    void scan(page_id id, key_type lo, key_type hi, Visit& visit) const {
+        Page page(m_pool, id);
+        const auto first = page->lower_bound(lo);
+        const auto last = page->lower_bound(hi);
+        if (page->leaf) {
+            for (auto i = first; i < last; ++i) {
+                visit(page->keys[i]);
+            }
+            return;
+        }
+
+        for (auto i = first; i <= last; ++i) {
+            for (auto j = i + 1; j <= std::min<size_type>(i + PREFETCH, last); ++j) {
+                m_pool.prefetch(page->children[j]);
+            }
+            scan(page->children[i], lo, hi, visit);
+            if (i < last) visit(page->keys[i]);
+        }
+    }
+
+    static std::string default_directory() {
+        const auto directory = std::getenv("TMPDIR");
+        return directory != nullptr ? directory : DEFAULT_DIRECTORY;
+    }
+
+public:
+    // Holds at most budget bytes of pages in memory, though never fewer than
+    // the few pages an update needs at once.
+    PagedBTree(size_type budget = DEFAULT_BUDGET, const std::string& directory = default_directory())
+        : m_pool(std::max(budget / PageSize, MIN_FRAMES), directory), m_size(0) {
+        m_root = create(true).id();
+    }
+
+    PagedBTree(const PagedBTree&) = delete;
+    PagedBTree& operator=(const PagedBTree&) = delete;
+
+    PagedBTree(PagedBTree&&) noexcept = default;
+    PagedBTree& operator=(PagedBTree&&) noexcept = default;
+
+    bool contains(key_type key) const {
+        Page page(m_pool, m_root);
+        while (true) {
+            const auto i = page->lower_bound(key);
+            if (i < page->size && page->keys[i] == key) return true;
+            if (page->leaf) return false;
+            page = Page(m_pool, page->children[i]);
+        }
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        std::optional<key_type> pred;
+        Page page(m_pool, m_root);
+        while (true) {
+            const auto i = page->lower_bound(key);
+            if (i > 0) pred = page->keys[i-1];
+            if (page->leaf) return pred;
+            page = Page(m_pool, page->children[i]);
+        }
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        std::optional<key_type> succ;
+        Page page(m_pool, m_root);
+        while (true) {
+            const auto i = page->upper_bound(key);
+            if (i < page->size) succ = page->keys[i];
+            if (page->leaf) return succ;
+            page = Page(m_pool, page->children[i]);
+        }
+    }
+
+    size_type size() const {
+        return m_size;
+    }
+
+    void insert(key_type key) {
+        Page page(m_pool, m_root);
+        if (page->full()) {
+            auto root = create(false);
+            root.edit().children[0] = m_root;
+            split(root, 0, page);
+            m_root = root.id();
+            page = std::move(root);
+        }
+
+        while (true) {
+            auto i = page->lower_bound(key);
+            if (i < page->size && page->keys[i] == key) return;
+
+            if (page->leaf) {
+                auto& node = page.edit();
+                std::copy_backward(node.keys.begin() + i, node.keys.begin() + node.size, node.keys.begin() + node.size + 1);
+                node.keys[i] = key;
+                ++node.size;
+                ++m_size;
+                return;
+            }
+
+            Page child(m_pool, page->children[i]);
+            if (child->full()) {
+                split(page, i, child);
+                if (key == page->keys[i]) return;
+                if (key > page->keys[i]) {
+                    child = Page(m_pool, page->children[i+1]);
+                }
+            }
+            page = std::move(child);
+        }
+    }
+
+    void remove(key_type key) {
+        Page page(m_pool, m_root);
+        while (true) {
+            const auto i = page->lower_bound(key);
+            const auto found = i < page->size && page->keys[i] == key;
+
+            if (page->leaf) {
+                if (found) {
+                    auto& node = page.edit();
+                    std::copy(node.keys.begin() + i + 1, node.keys.begin() + node.size, node.keys.begin() + i);
+                    --node.size;
+                    --m_size;
+                }
+                return;
+            }
+
+            auto child = found ? replace(page, i, key) : fill(page, i);
+
+            // The root empties when its last two children merge.
+            if (page.id() == m_root && page->size == 0) {
+                const auto id = page.id();
+                page.release();
+                m_pool.free(id);
+                m_root = child.id();
+            }
+            page = std::move(child);
+        }
+    }
+
+    // Calls visit on every key in [lo, hi) in increasing order.
+    template <class Visit>
+    void scan(key_type lo, key_type hi, Visit visit) const {
+        if (lo < hi) scan(m_root, lo, hi, visit);
+    }
+
+    // Writes every changed page back to the file.
+    void flush() {
+        m_pool.flush();
+    }
+
+    // The bytes of pages held in memory, which stay within the budget.
+    size_type memory() const {
+        return m_pool.memory();
+    }
+
+    // Pages read from and written to the file so far.
+    size_type reads() const {
+        return m_pool.reads();
+    }
+
+    size_type writes() const {
+        return m_pool.writes();
+    }
+};
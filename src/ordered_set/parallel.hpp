@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+// Runs fn(i, threads) for every i in [0, count), spreading the calls over at
+// most `threads` threads and splitting the thread budget between the calls.
+template <class Function>
+void parallel_invoke(size_t count, size_t threads, Function fn) {
+    const auto workers = std::max<size_t>(1, std::min(count, threads));
+    const auto budget = std::max<size_t>(1, threads / workers);
+
+    auto work = [&fn, count, workers, budget](size_t worker) {
+        for (size_t i = worker; i < count; i += workers) {
+            fn(i, budget);
+        }
+    };
+
+    // The calling thread takes the first share of the work.
+    std::vector<std::thread> pool;
+    for (size_t worker = 1; worker < workers; ++worker) {
+        pool.emplace_back(work, worker);
+    }
+    work(0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+// Runs fn(i) for every i in [0, count) on up to `threads` threads. Each
+// thread takes the next index whenever it finishes one, so calls of uneven
+// cost still keep every thread busy.
+template <class Function>
+void parallel_for_dynamic(size_t count, size_t threads, Function fn) {
+    std::atomic<size_t> next = 0;
+    auto work = [&fn, &next, count]() {
+        for (auto i = next++; i < count; i = next++) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t worker = 1; worker < std::min(count, threads); ++worker) {
+        pool.emplace_back(work);
+    }
+    work();
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+// Copies [first, last) into a sorted vector without duplicates. Chunks are
+// sorted on their own threads, then merged pairwise in parallel rounds.
+template <class Iterator>
+std::vector<typename std::iterator_traits<Iterator>::value_type>
+parallel_sort_unique(Iterator first, Iterator last, size_t threads) {
+    std::vector<typename std::iterator_traits<Iterator>::value_type> keys(first, last);
+
+    const auto size = keys.size();
+    const auto chunks = std::max<size_t>(1, std::min(threads, size));
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t i = 0; i <= chunks; ++i) {
+        bounds[i] = i * size / chunks;
+    }
+
+    parallel_invoke(chunks, threads, [&keys, &bounds](size_t i, size_t) {
+        std::sort(keys.begin() + bounds[i], keys.begin() + bounds[i+1]);
+    });
+
+    for (size_t width = 1; width < chunks; width *= 2) {
+        const auto merges = (chunks + 2 * width - 1) / (2 * width);
+        parallel_invoke(merges, threads, [&keys, &bounds, width, chunks](size_t i, size_t) {
+            const auto lo = 2 * i * width;
+            const auto mid = std::min(lo + width, chunks);
+            const auto hi = std::min(lo + 2 * width, chunks);
+            std::inplace_merge(
+                keys.begin() + bounds[lo],
+                keys.begin() + bounds[mid],
+                keys.begin() + bounds[hi]
+            );
+        });
+    }
+
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <vector>
+
+#include "sorted_keys.hpp"
+
+// A read-only ordered set in the style of the PGM index: the sorted keys are
+// covered by linear segments that each predict the position of any of their
+// keys to within Epsilon, so a lookup evaluates one segment and binary
+// searches a window of about 2 * Epsilon keys. The segments are found the
+// same way, by segments over their first keys with an error of at most
+// RecursiveEpsilon, level by level up to a single root segment.
+//
+// Segments are fitted greedily by shrinking the cone of slopes that keep
+// every key so far within the error, which takes a single pass, at the
+// price of somewhat more segments than the optimal fit.
+template <size_t Epsilon = 64, size_t RecursiveEpsilon = 4>
+class PgmIndex {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+private:
+    // Predicts first + slope * (x - key) for the keys from key on.
+    struct Segment {
+        key_type key;
+        double slope;
+        size_type first;
+    };
+
+    std::vector<key_type> m_keys;
+
+    // Level 0 covers the keys, every other level the first keys of the
+    // segments below it. The last level has a single segment.
+    std::vector<std::vector<Segment>> m_levels;
+
+    template <class Get>
+    static std::vector<Segment> fit(Get get, size_type size, double epsilon) {
+        std::vector<Segment> segments;
+        size_type i = 0;
+        while (i < size) {
+            const auto x = get(i);
+            double lo = 0;
+            double hi = std::numeric_limits<double>::infinity();
+
+            auto j = i + 1;
+            for (; j < size; ++j) {
+                const auto dx = static_cast<double>(get(j) - x);
+                const auto dy = static_cast<double>(j - i);
+                const auto low = (dy - epsilon) / dx;
+                const auto high = (dy + epsilon) / dx;
+                if (low > hi || high < lo) break;
+                lo = std::max(lo, low);
+                hi = std::min(hi, high);
+            }
+
+            const auto slope = j == i + 1 ? 0.0 : (lo + hi) / 2;
+            segments.push_back({x, slope, i});
+            i = j;
+        }
+        return segments;
+    }
+
+    // The index of the first of the values not less than x, given the
+    // segment that covers x. Falls back to searching the whole segment if
+    // rounding ever pushes the answer out of the window.
+    template <class Get>
+    static size_type lower_bound(Get get, size_type size, const std::vector<Segment>& segments, size_type s, key_type x, size_type epsilon) {
+        const auto& segment = segments[s];
+        const auto first = segment.first;
+        const auto end = s + 1 < segments.size() ? segments[s+1].first : size;
+        if (x <= segment.key) return first;
+
+        const auto guess = segment.first + segment.slope * static_cast<double>(x - segment.key);
+        const auto pos = static_cast<size_type>(std::clamp(guess, static_cast<double>(first), static_cast<double>(end)));
+        auto lo = pos > first + epsilon + 1 ? pos - epsilon - 1 : first;
+        auto hi = std::min(end, pos + epsilon + 2);
+        if ((lo > first && get(lo - 1) >= x) || (hi < end && get(hi) < x)) {
+            lo = first;
+            hi = end;
+        }
+
+        while (lo < hi) {
+            const auto mid = (lo + hi) / 2;
+            if (get(mid) < x) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // The index of the first key not less than x.
+    size_type lower_bound(key_type x) const {
+        if (m_keys.empty()) return 0;
+
+        size_type s = 0;
+        for (auto l = m_levels.size() - 1; l > 0; --l) {
+            const auto& below = m_levels[l-1];
+            auto get = [&below](size_type i) { return below[i].key; };
+            auto i = lower_bound(get, below.size(), m_levels[l], s, x, RecursiveEpsilon);
+
+            // The last segment starting at or before x.
+            s = i < below.size() && below[i].key == x ? i : std::max<size_type>(i, 1) - 1;
+        }
+
+        auto get = [this](size_type i) { return m_keys[i]; };
+        return lower_bound(get, m_keys.size(), m_levels[0], s, x, Epsilon);
+    }
+
+public:
+    // Builds the index over keys in strictly increasing order.
+    PgmIndex(std::vector<key_type> keys) : m_keys(std::move(keys)) {
+        if (m_keys.empty()) return;
+
+        m_levels.push_back(fit([this](size_type i) { return m_keys[i]; }, m_keys.size(), Epsilon));
+        while (m_levels.back().size() > 1) {
+            const auto& below = m_levels.back();
+            auto level = fit([&below](size_type i) { return below[i].key; }, below.size(), RecursiveEpsilon);
+            m_levels.push_back(std::move(level));
+        }
+    }
+
+    template <class OrderedSet>
+    static PgmIndex from(const OrderedSet& set) {
+        return PgmIndex(sorted_keys(set));
+    }
+
+    bool contains(key_type key) const {
+        const auto i = lower_bound(key);
+        return i < m_keys.size() && m_keys[i] == key;
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        const auto i = lower_bound(key);
+        if (i == 0) return std::nullopt;
+        return m_keys[i-1];
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        auto i = lower_bound(key);
+        if (i < m_keys.size() && m_keys[i] == key) ++i;
+        if (i == m_keys.size()) return std::nullopt;
+        return m_keys[i];
+    }
+
+    size_type size() const {
+        return m_keys.size();
+    }
+
+    // The segments on every level.
+    size_type segments() const {
+        size_type count = 0;
+        for (const auto& level : m_levels) {
+            count += level.size();
+        }
+        return count;
+    }
+
+    // The bytes taken by the segments, on top of the keys themselves.
+    size_type index_memory() const {
+        return segments() * sizeof(Segment);
+    }
+
+    size_type memory() const {
+        return m_keys.size() * sizeof(key_type) + index_memory();
+    }
+};
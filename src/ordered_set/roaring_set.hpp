@@ -0,0 +1,451 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// A set in the style of Roaring bitmaps: keys are grouped by their high 48
+// bits, and the low 16 bits of each group live in a container that is a
+// sorted array, a bitmap or a list of runs, whichever is smallest. Dense
+// groups then take about a bit per key, or a few bytes per run when they
+// are contiguous. Each container counts its keys and runs on every update,
+// so the choice follows the contents, with some slack against flipping back
+// and forth at the boundaries.
+//
+// Sparse keys pay for a container each, so this suits sets of clustered IDs
+// rather than random keys.
+class RoaringSet {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr size_type LOW_BITS = 16;
+
+private:
+    using low_type = uint16_t;
+
+    static constexpr uint32_t LOWS = 1 << LOW_BITS;
+    static constexpr size_type BITMAP_WORDS = LOWS / 64;
+    static constexpr size_type BITMAP_BYTES = BITMAP_WORDS * sizeof(uint64_t);
+
+    // Arrays are searched down to a block this long, which is then counted
+    // with vector compares.
+    static constexpr size_type RANK_BLOCK = 32;
+
+    enum Kind : uint8_t {
+        Array,
+        Bitmap,
+        Runs
+    };
+
+    // The lows from start to last, inclusive.
+    struct Run {
+        low_type start;
+        low_type last;
+    };
+
+    // Only the member of the kind is in use.
+    struct Container {
+        Kind kind = Kind::Array;
+        uint32_t count = 0;
+        uint32_t runs = 0;
+        std::vector<low_type> array;
+        std::vector<uint64_t> bitmap;
+        std::vector<Run> intervals;
+    };
+
+    std::map<key_type, Container> m_containers;
+    size_type m_size;
+
+    static key_type high_of(key_type key) {
+        return key >> LOW_BITS;
+    }
+
+    static low_type low_of(key_type key) {
+        return static_cast<low_type>(key);
+    }
+
+    static key_type join(key_type high, low_type low) {
+        return high << LOW_BITS | low;
+    }
+
+    // The number of lows less than x.
+    static size_type rank(const std::vector<low_type>& array, low_type x) {
+        const auto data = array.data();
+        size_type base = 0;
+        size_type len = array.size();
+        while (len > RANK_BLOCK) {
+            const auto half = len / 2;
+            if (data[base + half] < x) base += half;
+            len -= half;
+        }
+
+        size_type less = 0;
+        size_type i = 0;
+#ifdef __SSE2__
+        // SSE2 only compares signed words, so both sides are biased.
+        const auto bias = _mm_set1_epi16(static_cast<short>(0x8000));
+        const auto target = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(x)), bias);
+        for (; i + 8 <= len; i += 8) {
+            auto lows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + base + i));
+            auto mask = _mm_cmplt_epi16(_mm_xor_si128(lows, bias), target);
+            less += std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(mask))) / 2;
+        }
+#endif
+        for (; i < len; ++i) {
+            less += data[base + i] < x;
+        }
+        return base + less;
+    }
+
+    // Bitmaps.
+
+    static bool test(const Container& c, low_type x) {
+        return c.bitmap[x / 64] >> (x % 64) & 1;
+    }
+
+    static std::optional<low_type> bitmap_predecessor(const Container& c, low_type x) {
+        auto word = x / 64;
+        auto bits = c.bitmap[word] & ((uint64_t(1) << (x % 64)) - 1);
+        while (bits == 0) {
+            if (word == 0) return std::nullopt;
+            bits = c.bitmap[--word];
+        }
+        return word * 64 + 63 - std::countl_zero(bits);
+    }
+
+    static std::optional<low_type> bitmap_successor(const Container& c, low_type x) {
+        auto word = x / 64;
+        auto bits = x % 64 == 63 ? 0 : c.bitmap[word] & (~uint64_t(0) << (x % 64 + 1));
+        while (bits == 0) {
+            if (++word == BITMAP_WORDS) return std::nullopt;
+            bits = c.bitmap[word];
+        }
+        return word * 64 + std::countr_zero(bits);
+    }
+
+    // Runs.
+
+    // The index of the first run starting after x.
+    static size_type run_after(const Container& c, low_type x) {
+        return std::upper_bound(c.intervals.begin(), c.intervals.end(), x,
+            [](low_type x, const Run& run) { return x < run.start; }) - c.intervals.begin();
+    }
+
+    // Containers.
+
+    static bool contains(const Container& c, low_type x) {
+        switch (c.kind) {
+            case Kind::Array: {
+                auto i = rank(c.array, x);
+                return i < c.array.size() && c.array[i] == x;
+            }
+            case Kind::Bitmap:
+                return test(c, x);
+            case Kind::Runs: {
+                auto i = run_after(c, x);
+                return i > 0 && c.intervals[i-1].last >= x;
+            }
+        }
+        return false;
+    }
+
+    static std::optional<low_type> predecessor(const Container& c, low_type x) {
+        switch (c.kind) {
+            case Kind::Array: {
+                auto i = rank(c.array, x);
+                if (i == 0) return std::nullopt;
+                return c.array[i-1];
+            }
+            case Kind::Bitmap:
+                return bitmap_predecessor(c, x);
+            case Kind::Runs: {
+                // The last run starting before x.
+                auto i = run_after(c, x);
+                if (i > 0 && c.intervals[i-1].start == x) --i;
+                if (i == 0) return std::nullopt;
+                return std::min<low_type>(c.intervals[i-1].last, x - 1);
+            }
+        }
+        return std::nullopt;
+    }
+
+    static std::optional<low_type> successor(const Container& c, low_type x) {
+        switch (c.kind) {
+            case Kind::Array: {
+                auto i = rank(c.array, x);
+                if (i < c.array.size() && c.array[i] == x) ++i;
+                if (i == c.array.size()) return std::nullopt;
+                return c.array[i];
+            }
+            case Kind::Bitmap:
+                return bitmap_successor(c, x);
+            case Kind::Runs: {
+                auto i = run_after(c, x);
+                if (i > 0 && c.intervals[i-1].last > x) return x + 1;
+                if (i == c.intervals.size()) return std::nullopt;
+                return c.intervals[i].start;
+            }
+        }
+        return std::nullopt;
+    }
+
+    // Containers are never empty.
+    static low_type first(const Container& c) {
+        switch (c.kind) {
+            case Kind::Array:
+                return c.array.front();
+            case Kind::Bitmap:
+                return test(c, 0) ? 0 : *bitmap_successor(c, 0);
+            case Kind::Runs:
+                return c.intervals.front().start;
+        }
+        return 0;
+    }
+
+    static low_type last(const Container& c) {
+        switch (c.kind) {
+            case Kind::Array:
+                return c.array.back();
+            case Kind::Bitmap:
+                return test(c, LOWS - 1) ? LOWS - 1 : *bitmap_predecessor(c, LOWS - 1);
+            case Kind::Runs:
+                return c.intervals.back().last;
+        }
+        return 0;
+    }
+
+    // Whether x would extend or join the runs around it.
+    static std::pair<bool, bool> neighbours(const Container& c, low_type x) {
+        return {x > 0 && contains(c, x - 1), x < LOWS - 1 && contains(c, x + 1)};
+    }
+
+    // Adds x, which is not in the container.
+    static void add(Container& c, low_type x) {
+        auto [left, right] = neighbours(c, x);
+        c.runs = c.runs + 1 - left - right;
+        ++c.count;
+
+        switch (c.kind) {
+            case Kind::Array:
+                c.array.insert(c.array.begin() + rank(c.array, x), x);
+                break;
+            case Kind::Bitmap:
+                c.bitmap[x / 64] |= uint64_t(1) << (x % 64);
+                break;
+            case Kind::Runs: {
+                auto i = run_after(c, x);
+                if (left && right) {
+                    c.intervals[i-1].last = c.intervals[i].last;
+                    c.intervals.erase(c.intervals.begin() + i);
+                } else if (left) {
+                    c.intervals[i-1].last = x;
+                } else if (right) {
+                    c.intervals[i].start = x;
+                } else {
+                    c.intervals.insert(c.intervals.begin() + i, Run{x, x});
+                }
+                break;
+            }
+        }
+    }
+
+    // Takes out x, which is in the container.
+    static void take(Container& c, low_type x) {
+        auto [left, right] = neighbours(c, x);
+        c.runs = c.runs + left + right - 1;
+        --c.count;
+
+        switch (c.kind) {
+            case Kind::Array:
+                c.array.erase(c.array.begin() + rank(c.array, x));
+                break;
+            case Kind::Bitmap:
+                c.bitmap[x / 64] &= ~(uint64_t(1) << (x % 64));
+                break;
+            case Kind::Runs: {
+                auto i = run_after(c, x) - 1;
+                auto& run = c.intervals[i];
+                if (left && right) {
+                    auto rest = Run{static_cast<low_type>(x + 1), run.last};
+                    run.last = x - 1;
+                    c.intervals.insert(c.intervals.begin() + i + 1, rest);
+                } else if (left) {
+                    run.last = x - 1;
+                } else if (right) {
+                    run.start = x + 1;
+                } else {
+                    c.intervals.erase(c.intervals.begin() + i);
+                }
+                break;
+            }
+        }
+    }
+
+    static size_type cost(const Container& c, Kind kind) {
+        switch (kind) {
+            case Kind::Array:
+                return c.count * sizeof(low_type);
+            case Kind::Bitmap:
+                return BITMAP_BYTES;
+            case Kind::Runs:
+                return c.runs * sizeof(Run);
+        }
+        return 0;
+    }
+
+    static std::vector<low_type> lows(const Container& c) {
+        std::vector<low_type> lows;
+        lows.reserve(c.count);
+        switch (c.kind) {
+            case Kind::Array:
+                lows = c.array;
+                break;
+            case Kind::Bitmap:
+                for (size_type word = 0; word < BITMAP_WORDS; ++word) {
+                    for (auto bits = c.bitmap[word]; bits != 0; bits &= bits - 1) {
+                        lows.push_back(word * 64 + std::countr_zero(bits));
+                    }
+                }
+                break;
+            case Kind::Runs:
+                for (const auto& run : c.intervals) {
+                    for (uint32_t x = run.start; x <= run.last; ++x) {
+                        lows.push_back(x);
+                    }
+                }
+                break;
+        }
+        return lows;
+    }
+
+    // Switches to the smallest kind once the current one is a quarter
+    // larger, so that a container on the boundary does not convert on every
+    // update.
+    static void adapt(Container& c) {
+        auto best = c.kind;
+        for (auto kind : {Kind::Array, Kind::Bitmap, Kind::Runs}) {
+            if (cost(c, kind) < cost(c, best)) best = kind;
+        }
+        const auto current = cost(c, c.kind);
+        if (best == c.kind || current * 4 <= cost(c, best) * 5) return;
+
+        const auto values = lows(c);
+        c.array = std::vector<low_type>();
+        c.bitmap = std::vector<uint64_t>();
+        c.intervals = std::vector<Run>();
+        c.kind = best;
+
+        switch (best) {
+            case Kind::Array:
+                c.array = values;
+                break;
+            case Kind::Bitmap:
+                c.bitmap.assign(BITMAP_WORDS, 0);
+                for (const auto x : values) {
+                    c.bitmap[x / 64] |= uint64_t(1) << (x % 64);
+                }
+                break;
+            case Kind::Runs:
+                c.intervals.reserve(c.runs);
+                for (const auto x : values) {
+                    if (!c.intervals.empty() && c.intervals.back().last + 1 == x) {
+                        c.intervals.back().last = x;
+                    } else {
+                        c.intervals.push_back(Run{x, x});
+                    }
+                }
+                break;
+        }
+    }
+
+public:
+    RoaringSet() : m_size(0) {}
+
+    bool contains(key_type key) const {
+        auto it = m_containers.find(high_of(key));
+        return it != m_containers.end() && contains(it->second, low_of(key));
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        const auto high = high_of(key);
+        auto it = m_containers.lower_bound(high);
+        if (it != m_containers.end() && it->first == high) {
+            if (auto low = predecessor(it->second, low_of(key))) {
+                return join(high, *low);
+            }
+        }
+        if (it == m_containers.begin()) return std::nullopt;
+
+        --it;
+        return join(it->first, last(it->second));
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        const auto high = high_of(key);
+        auto it = m_containers.lower_bound(high);
+        if (it != m_containers.end() && it->first == high) {
+            if (auto low = successor(it->second, low_of(key))) {
+                return join(high, *low);
+            }
+            ++it;
+        }
+        if (it == m_containers.end()) return std::nullopt;
+
+        return join(it->first, first(it->second));
+    }
+
+    size_type size() const {
+        return m_size;
+    }
+
+    void insert(key_type key) {
+        auto& c = m_containers[high_of(key)];
+        const auto low = low_of(key);
+        if (contains(c, low)) return;
+
+        add(c, low);
+        adapt(c);
+        ++m_size;
+    }
+
+    void remove(key_type key) {
+        auto it = m_containers.find(high_of(key));
+        if (it == m_containers.end()) return;
+
+        auto& c = it->second;
+        const auto low = low_of(key);
+        if (!contains(c, low)) return;
+
+        take(c, low);
+        if (c.count == 0) {
+            m_containers.erase(it);
+        } else {
+            adapt(c);
+        }
+        --m_size;
+    }
+
+    // The bytes held by the containers, counting a map node per container.
+    size_type memory() const {
+        constexpr size_type NODE = 4 * sizeof(void*);
+
+        size_type bytes = 0;
+        for (const auto& [high, c] : m_containers) {
+            bytes += NODE + sizeof(high) + sizeof(c);
+            bytes += c.array.capacity() * sizeof(low_type);
+            bytes += c.bitmap.capacity() * sizeof(uint64_t);
+            bytes += c.intervals.capacity() * sizeof(Run);
+        }
+        return bytes;
+    }
+};
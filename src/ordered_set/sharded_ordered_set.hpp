@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+#include "sorted_keys.hpp"
+
+// Partitions the key space into ranges, each owned by its own sequential
+// ordered set. Batched updates are applied shard by shard across a few
+// threads, so an inner set is only ever touched by one thread at a time.
+template <class OrderedSet>
+class ShardedOrderedSet {
+public:
+    using key_type = typename OrderedSet::key_type;
+    using size_type = typename OrderedSet::size_type;
+
+    static constexpr size_type DEFAULT_SHARDS = 8;
+
+    // Rebalance when a shard holds more than SKEW times its fair share, but
+    // not before the set has MIN_REBALANCE keys per shard.
+    static constexpr size_type SKEW = 2;
+    static constexpr size_type MIN_REBALANCE = 64;
+
+private:
+    // Shard i owns the keys in [m_bounds[i], m_bounds[i+1]).
+    std::vector<key_type> m_bounds;
+    std::vector<OrderedSet> m_shards;
+    size_type m_size;
+
+    size_type shard_of(key_type key) const {
+        return std::upper_bound(m_bounds.begin(), m_bounds.end(), key) - m_bounds.begin() - 1;
+    }
+
+    bool skewed(size_type shard) const {
+        const auto count = m_shards.size();
+        return (
+            m_size >= count * MIN_REBALANCE
+            && m_shards[shard].size() > SKEW * m_size / count
+        );
+    }
+
+    // Removes and then inserts the keys for each shard, handing the shards
+    // out to up to `threads` threads as they finish.
+    void apply(
+        const std::vector<std::vector<key_type>>& removes,
+        const std::vector<std::vector<key_type>>& inserts,
+        size_type threads
+    ) {
+        parallel_for_dynamic(m_shards.size(), threads, [this, &removes, &inserts](size_type i) {
+            auto& shard = m_shards[i];
+            for (const auto key : removes[i]) {
+                shard.remove(key);
+            }
+            for (const auto key : inserts[i]) {
+                shard.insert(key);
+            }
+        });
+
+        m_size = 0;
+        for (const auto& shard : m_shards) {
+            m_size += shard.size();
+        }
+    }
+
+    void apply_batch(const std::vector<key_type>& keys, bool insert, size_type threads) {
+        std::vector<std::vector<key_type>> batches(m_shards.size());
+        for (const auto key : keys) {
+            batches[shard_of(key)].push_back(key);
+        }
+        const std::vector<std::vector<key_type>> none(m_shards.size());
+        if (insert) {
+            apply(none, batches, threads);
+        } else {
+            apply(batches, none, threads);
+        }
+
+        for (size_type i = 0; i < m_shards.size(); ++i) {
+            if (skewed(i)) {
+                rebalance(threads);
+                break;
+            }
+        }
+    }
+
+public:
+    // Asking for no shards gets one.
+    ShardedOrderedSet(size_type shards = DEFAULT_SHARDS)
+        : m_bounds(std::max<size_type>(shards, 1)), m_shards(m_bounds.size()), m_size(0) {
+        // Start by splitting the key space evenly.
+        const auto width = std::numeric_limits<key_type>::max() / m_shards.size() + 1;
+        for (size_type i = 0; i < m_shards.size(); ++i) {
+            m_bounds[i] = i * width;
+        }
+    }
+
+    bool contains(key_type key) const {
+        return m_shards[shard_of(key)].contains(key);
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        // Every key in an earlier shard is less than the key.
+        auto shard = shard_of(key);
+        auto pred = m_shards[shard].predecessor(key);
+        while (!pred.has_value() && shard > 0) {
+            pred = m_shards[--shard].predecessor(key);
+        }
+        return pred;
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        // Every key in a later shard is greater than the key.
+        auto shard = shard_of(key);
+        auto succ = m_shards[shard].successor(key);
+        while (!succ.has_value() && shard + 1 < m_shards.size()) {
+            succ = m_shards[++shard].successor(key);
+        }
+        return succ;
+    }
+
+    size_type size() const {
+        return m_size;
+    }
+
+    void insert(key_type key) {
+        const auto i = shard_of(key);
+        auto& shard = m_shards[i];
+        m_size -= shard.size();
+        shard.insert(key);
+        m_size += shard.size();
+        if (skewed(i)) rebalance();
+    }
+
+    void remove(key_type key) {
+        auto& shard = m_shards[shard_of(key)];
+        m_size -= shard.size();
+        shard.remove(key);
+        m_size += shard.size();
+    }
+
+    void insert_batch(const std::vector<key_type>& keys, size_type threads = std::thread::hardware_concurrency()) {
+        apply_batch(keys, true, std::max<size_type>(1, threads));
+    }
+
+    void remove_batch(const std::vector<key_type>& keys, size_type threads = std::thread::hardware_concurrency()) {
+        apply_batch(keys, false, std::max<size_type>(1, threads));
+    }
+
+    size_type shards() const {
+        return m_shards.size();
+    }
+
+    const OrderedSet& shard(size_type i) const {
+        return m_shards[i];
+    }
+
+    // Moves the boundaries to the quantiles of the keys and migrates the keys
+    // that changed owner between neighbouring shards.
+    void rebalance(size_type threads = std::thread::hardware_concurrency()) {
+        const auto count = m_shards.size();
+        if (m_size < count) return;
+
+        // The shards are ordered, so concatenating them sorts the keys.
+        std::vector<std::vector<key_type>> keys(count);
+        for (size_type i = 0; i < count; ++i) {
+            keys[i] = sorted_keys(m_shards[i]);
+        }
+
+        std::vector<key_type> bounds(count);
+        size_type rank = 0;
+        size_type shard = 0;
+        for (size_type i = 1; i < count; ++i) {
+            // Find the key with rank i * size / count.
+            auto target = i * m_size / count;
+            while (rank + keys[shard].size() <= target) {
+                rank += keys[shard].size();
+                ++shard;
+            }
+            bounds[i] = keys[shard][target - rank];
+        }
+        m_bounds = bounds;
+
+        // Remove the keys from their old shards and insert them into the new,
+        // in one pass since each shard only touches its own keys.
+        std::vector<std::vector<key_type>> removes(count);
+        std::vector<std::vector<key_type>> inserts(count);
+        for (size_type i = 0; i < count; ++i) {
+            for (const auto key : keys[i]) {
+                const auto j = shard_of(key);
+                if (i == j) continue;
+                removes[i].push_back(key);
+                inserts[j].push_back(key);
+            }
+        }
+        apply(removes, inserts, std::max<size_type>(1, threads));
+    }
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <limits>
+#include <optional>
+#include <vector>
+
+// Collects the keys of any ordered set in increasing order by walking
+// successors from the smallest possible key.
+template <class OrderedSet>
+std::vector<typename OrderedSet::key_type> sorted_keys(const OrderedSet& set) {
+    using key_type = typename OrderedSet::key_type;
+
+    std::vector<key_type> keys;
+    keys.reserve(set.size());
+
+    constexpr auto min = std::numeric_limits<key_type>::min();
+    auto key = set.contains(min) ? std::make_optional(min) : set.successor(min);
+    while (key.has_value()) {
+        keys.push_back(*key);
+        key = set.successor(*key);
+    }
+
+    return keys;
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+// A top-down splay tree. Every access rotates the key to the root, so hot
+// keys stay near the top and a skewed workload pays for the entropy of its
+// distribution instead of log n per access.
+//
+// In semi-splay mode, reads only splay keys deeper than SHALLOW, so the hot
+// keys that have already been pulled up near the root are read without
+// rewriting any node. Updates always splay.
+template <bool Semi = false>
+class SplayTree {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr size_type SHALLOW = 12;
+
+private:
+    struct Node {
+        key_type key;
+        Node* left;
+        Node* right;
+
+        Node(key_type key)
+            : key(key), left(nullptr), right(nullptr) {}
+    };
+
+    using node_value = Node;
+    using node_ptr = node_value*;
+
+    node_ptr m_root;
+    size_type m_size;
+
+    // Brings the key, or the last node on its search path, to the root.
+    static node_ptr splay(node_ptr root, key_type key) {
+        if (root == nullptr) {
+            return root;
+        }
+
+        // The nodes less than the key hang off the right spine of left, the
+        // greater ones off the left spine of right.
+        node_value header(0);
+        node_ptr left = &header;
+        node_ptr right = &header;
+
+        while (key != root->key) {
+            if (key < root->key) {
+                if (root->left == nullptr) break;
+
+                // Zig-zig: rotate right first.
+                if (key < root->left->key) {
+                    auto child = root->left;
+                    root->left = child->right;
+                    child->right = root;
+                    root = child;
+                    if (root->left == nullptr) break;
+                }
+
+                // Link right.
+                right->left = root;
+                right = root;
+                root = root->left;
+            } else {
+                if (root->right == nullptr) break;
+
+                // Zag-zag: rotate left first.
+                if (key > root->right->key) {
+                    auto child = root->right;
+                    root->right = child->left;
+                    child->left = root;
+                    root = child;
+                    if (root->right == nullptr) break;
+                }
+
+                // Link left.
+                left->right = root;
+                left = root;
+                root = root->right;
+            }
+        }
+
+        // Reassemble.
+        left->right = root->left;
+        right->left = root->right;
+        root->left = header.right;
+        root->right = header.left;
+        return root;
+    }
+
+    // Plain descents that leave the tree as it is. They give up and return
+    // false if the answer lies deeper than SHALLOW, so that it gets splayed.
+    bool find_predecessor(key_type key, std::optional<key_type>& pred) const {
+        size_type depth = 0;
+        for (auto node = m_root; node != nullptr; ) {
+            if (depth++ > SHALLOW) {
+                return false;
+            }
+            if (node->key < key) {
+                pred = node->key;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return true;
+    }
+
+    bool find_successor(key_type key, std::optional<key_type>& succ) const {
+        size_type depth = 0;
+        for (auto node = m_root; node != nullptr; ) {
+            if (depth++ > SHALLOW) {
+                return false;
+            }
+            if (node->key > key) {
+                succ = node->key;
+                node = node->left;
+            } else {
+                node = node->right;
+            }
+        }
+        return true;
+    }
+
+public:
+    SplayTree() : m_root(nullptr), m_size(0) {}
+
+    SplayTree(const SplayTree&) = delete;
+    SplayTree& operator=(const SplayTree&) = delete;
+
+    SplayTree(SplayTree&& other) noexcept : m_root(other.m_root), m_size(other.m_size) {
+        other.m_root = nullptr;
+        other.m_size = 0;
+    }
+
+    SplayTree& operator=(SplayTree&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    void swap(SplayTree& other) noexcept {
+        std::swap(m_root, other.m_root);
+        std::swap(m_size, other.m_size);
+    }
+
+    friend void swap(SplayTree& a, SplayTree& b) noexcept {
+        a.swap(b);
+    }
+
+    ~SplayTree() {
+        // Rotate left children up so that the tree can be freed along its
+        // right spine, without recursing down a path that may be very deep.
+        while (m_root != nullptr) {
+            if (m_root->left != nullptr) {
+                auto child = m_root->left;
+                m_root->left = child->right;
+                child->right = m_root;
+                m_root = child;
+            } else {
+                auto right = m_root->right;
+                delete m_root;
+                m_root = right;
+            }
+        }
+    }
+
+    bool contains(key_type key) {
+        if constexpr (Semi) {
+            // Answer from the first SHALLOW levels if the search ends there.
+            size_type depth = 0;
+            auto node = m_root;
+            while (node != nullptr && node->key != key && depth++ < SHALLOW) {
+                node = key < node->key ? node->left : node->right;
+            }
+            if (depth <= SHALLOW) {
+                return node != nullptr && node->key == key;
+            }
+        }
+
+        m_root = splay(m_root, key);
+        return m_root != nullptr && m_root->key == key;
+    }
+
+    std::optional<key_type> predecessor(key_type key) {
+        if constexpr (Semi) {
+            std::optional<key_type> pred;
+            if (find_predecessor(key, pred)) return pred;
+        }
+
+        // The root is now either the key or one of its neighbours.
+        m_root = splay(m_root, key);
+        if (m_root == nullptr) {
+            return std::nullopt;
+        }
+        if (m_root->key < key) {
+            return m_root->key;
+        }
+        if (m_root->left == nullptr) {
+            return std::nullopt;
+        }
+
+        // Splaying the key in the left subtree brings its maximum up to
+        // the root's left child, so asking again stays cheap.
+        m_root->left = splay(m_root->left, key);
+        return m_root->left->key;
+    }
+
+    std::optional<key_type> successor(key_type key) {
+        if constexpr (Semi) {
+            std::optional<key_type> succ;
+            if (find_successor(key, succ)) return succ;
+        }
+
+        m_root = splay(m_root, key);
+        if (m_root == nullptr) {
+            return std::nullopt;
+        }
+        if (m_root->key > key) {
+            return m_root->key;
+        }
+        if (m_root->right == nullptr) {
+            return std::nullopt;
+        }
+
+        m_root->right = splay(m_root->right, key);
+        return m_root->right->key;
+    }
+
+    size_type size() const {
+        return m_size;
+    }
+
+    void insert(key_type key) {
+        m_root = splay(m_root, key);
+        if (m_root != nullptr && m_root->key == key) {
+            return;
+        }
+
+        // Split the tree around the new root.
+        auto node = new node_value(key);
+        if (m_root != nullptr) {
+            if (key < m_root->key) {
+                node->left = m_root->left;
+                node->right = m_root;
+                m_root->left = nullptr;
+            } else {
+                node->right = m_root->right;
+                node->left = m_root;
+                m_root->right = nullptr;
+            }
+        }
+        m_root = node;
+        ++m_size;
+    }
+
+    void remove(key_type key) {
+        m_root = splay(m_root, key);
+        if (m_root == nullptr || m_root->key != key) {
+            return;
+        }
+
+        // Every key on the left is less, so splaying the key there brings
+        // the maximum up with no right child, ready to take the right side.
+        auto root = m_root;
+        if (root->left == nullptr) {
+            m_root = root->right;
+        } else {
+            m_root = splay(root->left, key);
+            m_root->right = root->right;
+        }
+        delete root;
+        --m_size;
+    }
+};
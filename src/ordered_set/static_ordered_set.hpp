@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+
+// A fixed table of N keys that can be built entirely at compile time, for
+// key sets known when the program is built. The keys live in a sorted
+// array inside the object, so a constexpr table costs no allocation and no
+// work at startup. Lookups are a binary search whose steps are unrolled by
+// the template, each stepping into the upper half by the outcome of the
+// comparison rather than by a branch, and a single equality check at the end.
+template <size_t N>
+class StaticOrderedSet {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+private:
+    std::array<key_type, N> m_keys;
+
+    // The index of the first key not less than x among the Length keys from
+    // base on. Compilers tend to turn a select between the halves back into
+    // a branch, but not a multiplication.
+    template <size_type Length>
+    constexpr size_type lower_bound(size_type base, key_type x) const {
+        if constexpr (Length <= 1) {
+            return base + (m_keys[base] < x);
+        } else {
+            constexpr auto half = Length / 2;
+            base += (m_keys[base + half] < x) * half;
+            return lower_bound<Length - half>(base, x);
+        }
+    }
+
+    constexpr size_type lower_bound(key_type x) const {
+        if constexpr (N == 0) {
+            return 0;
+        } else {
+            return lower_bound<N>(0, x);
+        }
+    }
+
+public:
+    // The keys may come in any order, but must be distinct.
+    constexpr StaticOrderedSet(std::array<key_type, N> keys) : m_keys(keys) {
+        std::sort(m_keys.begin(), m_keys.end());
+        assert(std::adjacent_find(m_keys.begin(), m_keys.end()) == m_keys.end());
+    }
+
+    constexpr bool contains(key_type key) const {
+        const auto i = lower_bound(key);
+        return i < N && m_keys[i] == key;
+    }
+
+    constexpr std::optional<key_type> predecessor(key_type key) const {
+        const auto i = lower_bound(key);
+        if (i == 0) return std::nullopt;
+        return m_keys[i-1];
+    }
+
+    constexpr std::optional<key_type> successor(key_type key) const {
+        auto i = lower_bound(key);
+        if (i < N && m_keys[i] == key) ++i;
+        if (i == N) return std::nullopt;
+        return m_keys[i];
+    }
+
+    constexpr size_type size() const {
+        return N;
+    }
+};
+
+// The set of the keys given as template arguments, built at compile time:
+//
+//   constexpr auto& reserved = static_ordered_set<0, 1, 1024, 65535>;
+template <uint64_t... Keys>
+inline constexpr StaticOrderedSet<sizeof...(Keys)> static_ordered_set{
+    std::array<uint64_t, sizeof...(Keys)>{Keys...}
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "sorted_keys.hpp"
+
+// A complete binary search tree over a sorted array. Nodes are identified by
+// their BFS index (root is 1, children of i are 2i and 2i+1) and a layout maps
+// the index to a position in memory while descending.
+
+// Breadth-first (Eytzinger) layout. The first levels are packed together, but
+// every level below the cache block size costs another miss.
+class BfsLayout {
+public:
+    using size_type = size_t;
+
+    class Walker {
+        size_type m_index = 1;
+
+    public:
+        Walker(const BfsLayout&) {}
+
+        size_type position() const {
+            return m_index - 1;
+        }
+
+        void down(bool right) {
+            m_index = 2 * m_index + right;
+        }
+    };
+
+    BfsLayout(size_type) {}
+};
+
+// Recursive van Emde Boas layout. A tree of height h is cut at half its height
+// into a top tree and the bottom trees hanging off it, the top tree is stored
+// first and the bottom trees after it, each laid out recursively. A root to
+// leaf path then touches O(log_B n) blocks for every block size B at once.
+class VebLayout {
+public:
+    using size_type = size_t;
+
+    static constexpr size_type MAX_HEIGHT = 64;
+
+    // For the cut where depth d holds the roots of the bottom trees, m_top[d]
+    // is the size of the top tree, m_bottom[d] the size of each bottom tree and
+    // m_depth[d] the depth of the top tree's root.
+    std::array<size_type, MAX_HEIGHT> m_top;
+    std::array<size_type, MAX_HEIGHT> m_bottom;
+    std::array<size_type, MAX_HEIGHT> m_depth;
+
+    void cut(size_type depth, size_type height) {
+        if (height <= 1) {
+            return;
+        }
+
+        auto top = height / 2;
+        auto bottom = height - top;
+        m_top[depth + top] = (size_type(1) << top) - 1;
+        m_bottom[depth + top] = (size_type(1) << bottom) - 1;
+        m_depth[depth + top] = depth;
+
+        cut(depth, top);
+        cut(depth + top, bottom);
+    }
+
+public:
+    class Walker {
+        const VebLayout& m_layout;
+        size_type m_index = 1;
+        size_type m_level = 0;
+        std::array<size_type, MAX_HEIGHT> m_positions;
+
+    public:
+        Walker(const VebLayout& layout) : m_layout(layout) {
+            m_positions[0] = 0;
+        }
+
+        size_type position() const {
+            return m_positions[m_level];
+        }
+
+        void down(bool right) {
+            m_index = 2 * m_index + right;
+            ++m_level;
+
+            // The low bits of the index select the bottom tree below the
+            // top tree's root, which was visited earlier on this path.
+            const auto top = m_layout.m_top[m_level];
+            m_positions[m_level] = (
+                m_positions[m_layout.m_depth[m_level]]
+                + top
+                + (m_index & top) * m_layout.m_bottom[m_level]
+            );
+        }
+    };
+
+    VebLayout(size_type height) {
+        m_top.fill(0);
+        m_bottom.fill(0);
+        m_depth.fill(0);
+        cut(0, height);
+    }
+};
+
+// A read-only ordered set stored as a static search tree in the given layout.
+template <class Layout>
+class StaticSearchTree {
+public:
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+private:
+    using walker_type = typename Layout::Walker;
+
+    size_type m_size;
+    size_type m_height;
+    Layout m_layout;
+    std::vector<key_type> m_keys;
+
+    static size_type height_for(size_type size) {
+        size_type height = 0;
+        while (((size_type(1) << height) - 1) < size) ++height;
+        return height;
+    }
+
+    // Fill the tree in order. Missing leaves are padded with the largest key,
+    // which never changes the answer to a query.
+    void build(walker_type walker, size_type depth, const std::vector<key_type>& keys, size_type& next) {
+        if (depth == m_height) {
+            return;
+        }
+
+        auto left = walker;
+        left.down(false);
+        build(left, depth + 1, keys, next);
+
+        m_keys[walker.position()] = keys[next < keys.size() ? next : keys.size() - 1];
+        ++next;
+
+        auto right = walker;
+        right.down(true);
+        build(right, depth + 1, keys, next);
+    }
+
+public:
+    // Builds the tree from keys in strictly increasing order.
+    StaticSearchTree(const std::vector<key_type>& keys)
+        : m_size(keys.size()),
+          m_height(height_for(keys.size())),
+          m_layout(m_height),
+          m_keys((size_type(1) << m_height) - 1) {
+        size_type next = 0;
+        build(walker_type(m_layout), 0, keys, next);
+    }
+
+    template <class OrderedSet>
+    static StaticSearchTree from(const OrderedSet& set) {
+        return StaticSearchTree(sorted_keys(set));
+    }
+
+    bool contains(key_type key) const {
+        // Find the smallest key at least the key and compare once at the end.
+        walker_type walker(m_layout);
+        auto found = false;
+        key_type lower = 0;
+        for (size_type depth = 0; depth < m_height; ++depth) {
+            const auto node = m_keys[walker.position()];
+            const auto right = node < key;
+            found |= !right;
+            lower = right ? lower : node;
+            walker.down(right);
+        }
+        return found && lower == key;
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        walker_type walker(m_layout);
+        auto found = false;
+        key_type pred = 0;
+        for (size_type depth = 0; depth < m_height; ++depth) {
+            const auto node = m_keys[walker.position()];
+            const auto right = node < key;
+            found |= right;
+            pred = right ? node : pred;
+            walker.down(right);
+        }
+        return found ? std::make_optional(pred) : std::nullopt;
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        walker_type walker(m_layout);
+        auto found = false;
+        key_type succ = 0;
+        for (size_type depth = 0; depth < m_height; ++depth) {
+            const auto node = m_keys[walker.position()];
+            const auto right = node <= key;
+            found |= !right;
+            succ = right ? succ : node;
+            walker.down(right);
+        }
+        return found ? std::make_optional(succ) : std::nullopt;
+    }
+
+    size_type size() const {
+        return m_size;
+    }
+};
+
+using BfsSearchTree = StaticSearchTree<BfsLayout>;
+using VebSearchTree = StaticSearchTree<VebLayout>;
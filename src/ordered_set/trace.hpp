@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// A recorded sequence of ordered set operations. On disk a trace is the
+// magic bytes followed by one packed record per operation: the operation
+// byte and then the key, little-endian. Records are only ever appended, so
+// a trace can be captured as a stream and a file cut short loses at most
+// its last record.
+enum class Op : uint8_t {
+    Insert,
+    Remove,
+    Contains,
+    Predecessor,
+    Successor
+};
+
+static constexpr size_t OPS = 5;
+
+inline const char* op_name(Op op) {
+    static constexpr std::array<const char*, OPS> names{"insert", "remove", "contains", "predecessor", "successor"};
+    return names[static_cast<size_t>(op)];
+}
+
+struct Trace {
+    using key_type = uint64_t;
+    using size_type = size_t;
+
+    static constexpr std::array<char, 8> MAGIC{'O', 'S', 'T', 'R', 'A', 'C', 'E', '1'};
+    static constexpr size_type RECORD = 1 + sizeof(key_type);
+
+    std::vector<Op> ops;
+    std::vector<key_type> keys;
+
+    size_type size() const {
+        return ops.size();
+    }
+
+    void push_back(Op op, key_type key) {
+        ops.push_back(op);
+        keys.push_back(key);
+    }
+};
+
+inline bool write_trace(std::ostream& out, const Trace& trace) {
+    out.write(Trace::MAGIC.data(), Trace::MAGIC.size());
+
+    std::array<char, Trace::RECORD> record;
+    for (size_t i = 0; i < trace.size(); ++i) {
+        record[0] = static_cast<char>(trace.ops[i]);
+        for (size_t b = 0; b < sizeof(Trace::key_type); ++b) {
+            record[1 + b] = static_cast<char>(trace.keys[i] >> (8 * b));
+        }
+        out.write(record.data(), record.size());
+    }
+    return out.good();
+}
+
+// Fails on a bad header or an unknown operation. A partial last record, as
+// left by a capture that was cut short, is dropped.
+inline std::optional<Trace> read_trace(std::istream& in) {
+    std::array<char, Trace::MAGIC.size()> magic;
+    if (!in.read(magic.data(), magic.size()) || magic != Trace::MAGIC) {
+        return std::nullopt;
+    }
+
+    Trace trace;
+    std::array<char, Trace::RECORD> record;
+    while (in.read(record.data(), record.size())) {
+        auto op = static_cast<uint8_t>(record[0]);
+        if (op >= OPS) return std::nullopt;
+
+        Trace::key_type key = 0;
+        for (size_t b = 0; b < sizeof(Trace::key_type); ++b) {
+            key |= static_cast<Trace::key_type>(static_cast<uint8_t>(record[1 + b])) << (8 * b);
+        }
+        trace.push_back(static_cast<Op>(op), key);
+    }
+    return trace;
+}
+
+// Runs one operation. Queries return their answer, with contains() giving
+// the key if it is present; updates return nothing.
+template <class OrderedSet>
+std::optional<typename OrderedSet::key_type> apply(OrderedSet& set, Op op, typename OrderedSet::key_type key) {
+    switch (op) {
+        case Op::Insert:
+            set.insert(key);
+            break;
+        case Op::Remove:
+            set.remove(key);
+            break;
+        case Op::Contains:
+            if (set.contains(key)) return key;
+            break;
+        case Op::Predecessor:
+            return set.predecessor(key);
+        case Op::Successor:
+            return set.successor(key);
+    }
+    return std::nullopt;
+}
+
+// Forwards to an ordered set and records every call, to capture the
+// traffic of a running service for replay.
+template <class OrderedSet>
+class RecordingOrderedSet {
+public:
+    using key_type = typename OrderedSet::key_type;
+    using size_type = typename OrderedSet::size_type;
+
+private:
+    OrderedSet m_set;
+    mutable Trace m_trace;
+
+public:
+    RecordingOrderedSet() {}
+
+    bool contains(key_type key) const {
+        m_trace.push_back(Op::Contains, key);
+        return m_set.contains(key);
+    }
+
+    std::optional<key_type> predecessor(key_type key) const {
+        m_trace.push_back(Op::Predecessor, key);
+        return m_set.predecessor(key);
+    }
+
+    std::optional<key_type> successor(key_type key) const {
+        m_trace.push_back(Op::Successor, key);
+        return m_set.successor(key);
+    }
+
+    size_type size() const {
+        return m_set.size();
+    }
+
+    void insert(key_type key) {
+        m_trace.push_back(Op::Insert, key);
+        m_set.insert(key);
+    }
+
+    void remove(key_type key) {
+        m_trace.push_back(Op::Remove, key);
+        m_set.remove(key);
+    }
+
+    const Trace& trace() const {
+        return m_trace;
+    }
+
+    // Hands over the trace recorded so far and starts a new one.
+    Trace take() {
+        return std::exchange(m_trace, Trace());
+    }
+};
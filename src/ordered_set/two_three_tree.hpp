@@ -1,7 +1,16 @@
+#pragma once
+
+#include <algorithm>
 #include <array>
 #include <optional>
 #include <cinttypes>
 #include <cassert>
+#include <utility>
+#include <vector>
+
+#include "finger.hpp"
+#include "node_pool.hpp"
+#include "parallel.hpp"
 
 class TwoThreeTree {
 public:
@@ -54,17 +63,29 @@ private:
     using node_value = Node;
     using node_ptr = Node*;
 
+public:
+    using Finger = ::Finger<Node, key_type, 64>;
+
+private:
+    NodePool<Node> m_pool;
     node_ptr m_root;
     size_type m_size;
 
+    // Bumped by every update so that stale fingers can be detected.
+    size_type m_version;
+
     static constexpr size_type HOLE = 0;
     static constexpr size_type KICK = 3;
 
+    // The number of keys in the node less than the key, or not greater than
+    // it if Upper. Counts the comparisons instead of searching, so there is
+    // nothing to mispredict.
+    template <bool Upper = false>
     static size_type find_pivot(const node_ptr root, const key_type key) {
         assert(root != nullptr);
-        auto it = std::lower_bound(
-            root->keys.begin(), root->keys.begin() + root->size, key);
-        return std::distance(root->keys.begin(), it);
+        const auto below = [key](key_type k) { return Upper ? k <= key : k < key; };
+        return size_type(below(root->keys[0]) & (root->size > 0))
+            + size_type(below(root->keys[1]) & (root->size > 1));
     }
 
     static node_ptr rotate(node_ptr root, const size_type pivot) {
@@ -151,7 +172,7 @@ private:
         return root;
     }
 
-    static node_ptr merge(node_ptr root, const size_type pivot) {
+    node_ptr merge(node_ptr root, const size_type pivot) {
         assert(root != nullptr);
         assert(pivot <= root->size);
 
@@ -217,7 +238,7 @@ private:
         assert(l->ok());
 
         // Merge right subtree.
-        delete r;
+        m_pool.destroy(r);
 
         // Merge root.
         root->children[li] = l;
@@ -233,7 +254,7 @@ private:
         return root;
     }
 
-    static node_ptr split(node_ptr root, const size_type pivot) {
+    node_ptr split(node_ptr root, const size_type pivot) {
         assert(root->size == 2);
         assert(pivot <= root->size);
 
@@ -279,7 +300,7 @@ private:
         kick->size = 1;
         assert(kick->ok());
 
-        auto node = new node_value({z, 0}, {c, d, nullptr}, 1);
+        auto node = m_pool.create(std::array<key_type, 2>{z, 0}, std::array<node_ptr, 3>{c, d, nullptr}, 1);
         assert(node->ok());
 
         root->keys[0] = y;
@@ -292,89 +313,61 @@ private:
         return root;
     }
 
-    bool contains(const node_ptr root, const key_type key) const {
-        if (root == nullptr) {
-            return false;
-        }
-
-        const auto pivot = find_pivot(root, key);
-        if ((pivot < root->size) && (key == root->keys[pivot])) {
-            return true;
-        }
-
-        return contains(root->children[pivot], key);
+    // Either key by the condition, with a mask rather than a branch.
+    static key_type choose(bool condition, key_type a, key_type b) {
+        const auto mask = -key_type(condition);
+        return (a & mask) | (b & ~mask);
     }
 
-    node_ptr predecessor(const node_ptr root, const key_type key) const {
-        if (root == nullptr) {
-            return nullptr;
-        }
-
-        auto pivot = find_pivot(root, key);
-
-        // case; no key and has left > in left or current or parent
-        // case; no key and no left > current or parent
-        if (pivot == root->size || root->keys[pivot] != key) {
-            const auto pred = predecessor(root->children[pivot], key);
-            if (pred == nullptr && pivot != 0) {
-                return root;
-            }
-            return pred;
-        }
-
-        // case; found key and has right subtree > succ is rllll...
-        // case; found key and no right > current or parent
-        else {
-            if (root->children[pivot] == nullptr) {
-                return pivot != 0 ? root : nullptr;
-            }
-
-            auto pred = root->children[pivot];
-            while (pred->children[find_pivot(pred, key)] != nullptr) {
-                pred = pred->children[find_pivot(pred, key)];
-            }
-            return pred;
+    // Lookups descend all the way to a leaf, which in a 2-3 tree is always
+    // the same number of levels, and keep the best key so far with masks, so
+    // that the only branch is the loop's own. The key itself is checked
+    // once, at the end. Keys at a pivot past the node's keys are read but
+    // never chosen.
+
+    bool contains(node_ptr root, const key_type key) const {
+        key_type bound = 0;
+        bool found = false;
+        while (root != nullptr) {
+            const auto pivot = find_pivot(root, key);
+            const bool hit = pivot < root->size;
+            bound = choose(hit, root->keys[pivot & 1], bound);
+            found |= hit;
+            root = root->children[pivot];
         }
+        return found && bound == key;
     }
 
-    // goal: return the node that contains the successor of the key
-    node_ptr successor(const node_ptr root, const key_type key) const {
-        if (root == nullptr) {
-            return nullptr;
+    std::optional<key_type> predecessor(node_ptr root, const key_type key) const {
+        key_type pred = 0;
+        bool found = false;
+        while (root != nullptr) {
+            const auto pivot = find_pivot(root, key);
+            const bool hit = pivot > 0;
+            pred = choose(hit, root->keys[(pivot - 1) & 1], pred);
+            found |= hit;
+            root = root->children[pivot];
         }
+        return found ? std::make_optional(pred) : std::nullopt;
+    }
 
-        auto pivot = find_pivot(root, key);
-
-        // case; no key and has right > in right or current or parent
-        // case; no key and no right > current or parent
-        if (pivot == root->size || root->keys[pivot] != key) {
-            const auto succ = successor(root->children[pivot], key);
-            if (succ == nullptr && pivot != root->size) {
-                return root;
-            }
-            return succ;
-        }
-
-        // case; found key and has right subtree > succ is rllll...
-        // case; found key and no right > current or parent
-        else {
-            ++pivot;
-            if (root->children[pivot] == nullptr) {
-                return pivot != root->size ? root : nullptr;
-            }
-
-            auto succ = root->children[pivot];
-            while (succ->children[0] != nullptr) {
-                succ = succ->children[0];
-            }
-            return succ;
+    std::optional<key_type> successor(node_ptr root, const key_type key) const {
+        key_type succ = 0;
+        bool found = false;
+        while (root != nullptr) {
+            const auto pivot = find_pivot<true>(root, key);
+            const bool hit = pivot < root->size;
+            succ = choose(hit, root->keys[pivot & 1], succ);
+            found |= hit;
+            root = root->children[pivot];
         }
+        return found ? std::make_optional(succ) : std::nullopt;
     }
 
     node_ptr insert(node_ptr root, key_type key) {
         if (root == nullptr) {
             ++m_size;
-            return new node_value({key, 0}, {nullptr, nullptr, nullptr}, KICK);
+            return m_pool.create(std::array<key_type, 2>{key, 0}, std::array<node_ptr, 3>{nullptr, nullptr, nullptr}, KICK);
         }
 
         auto pivot = find_pivot(root, key);
@@ -388,17 +381,48 @@ private:
             return root;
         }
 
+        return absorb(root, pivot);
+    }
+
+    // Takes in the key kicked up by the child at the pivot.
+    node_ptr absorb(node_ptr root, const size_type pivot) {
+        assert(root->children[pivot]->size == KICK);
+
+        // If the root has room, merge it into the kicked child.
         if (root->size == 1) {
             root->children[pivot]->size = 1;
-            root->children[1-pivot] = new node_value({0, 0}, {root->children[1-pivot], nullptr, nullptr}, HOLE);
-            // TODO: Fix memory leak.
-            root = merge(root, 1-pivot)->children[0];
-            return root;
+            root->children[1-pivot] = m_pool.create(std::array<key_type, 2>{0, 0}, std::array<node_ptr, 3>{root->children[1-pivot], nullptr, nullptr}, HOLE);
+            auto node = merge(root, 1-pivot)->children[0];
+            m_pool.destroy(root);
+            return node;
         }
 
         return split(root, pivot);
     }
 
+    // Extends the finger from its last entry down to the key's node, or to
+    // the leaf the key would be inserted into.
+    void descend(Finger& finger, key_type key) const {
+        auto entry = finger.path[finger.depth-1];
+        while (true) {
+            auto node = entry.node;
+            auto pivot = find_pivot(node, key);
+            if (node->children[0] == nullptr || (pivot < node->size && key == node->keys[pivot])) {
+                break;
+            }
+
+            finger.path[finger.depth-1].index = pivot;
+            entry = {
+                node->children[pivot], 0,
+                pivot > 0 ? node->keys[pivot-1] : entry.lo,
+                pivot < node->size ? node->keys[pivot] : entry.hi,
+                pivot > 0 || entry.has_lo,
+                pivot < node->size || entry.has_hi
+            };
+            finger.path[finger.depth++] = entry;
+        }
+    }
+
     node_ptr remove(node_ptr root, key_type key) {
         if (root == nullptr) {
             return nullptr;
@@ -435,38 +459,155 @@ private:
             return root;
         }
 
-        auto is_rotate = (
-            (pivot == 0 && root->children[pivot+1]->size == 2)
-            || (pivot == root->size && root->children[pivot-1]->size == 2)
-            || (pivot != 0 && pivot != root->size && (root->children[pivot+1]->size == 2 || root->children[pivot-1]->size == 2))
-        );
-        if (is_rotate) {
+        // Borrow from a neighbour with a key to spare, if there is one.
+        const auto left = pivot > 0 && root->children[pivot-1]->size == 2;
+        const auto right = pivot < root->size && root->children[pivot+1]->size == 2;
+        if (left || right) {
             return rotate(root, pivot);
         }
         return merge(root, pivot);
     }
 
+    // The most keys a subtree of the given height can hold.
+    static size_type capacity(size_type height) {
+        size_type capacity = 1;
+        for (size_type i = 0; i < height; ++i) {
+            capacity *= 3;
+        }
+        return capacity - 1;
+    }
+
+    // Builds a subtree of the given height over keys[lo, hi). The node gets
+    // as few children as can hold the keys and the keys are spread evenly
+    // between them, which keeps every child non-empty.
+    static node_ptr build(const std::vector<key_type>& keys, size_type lo, size_type hi, size_type height, size_type threads, NodePool<Node>& pool) {
+        auto count = hi - lo;
+
+        // If the node is a leaf, copy the keys in.
+        if (height == 1) {
+            assert(count == 1 || count == 2);
+            auto node = pool.create(std::array<key_type, 2>{keys[lo], count == 2 ? keys[lo+1] : 0}, std::array<node_ptr, 3>{nullptr, nullptr, nullptr}, count);
+            assert(node->ok());
+            return node;
+        }
+
+        // Otherwise, split the keys between the children and separators.
+        auto child_capacity = capacity(height-1);
+        size_type children = (count + 1 + child_capacity) / (child_capacity + 1);
+        assert(children == 2 || children == 3);
+
+        auto node = pool.create(std::array<key_type, 2>{0, 0}, std::array<node_ptr, 3>{nullptr, nullptr, nullptr}, children - 1);
+        auto child_keys = count - (children - 1);
+        std::array<size_type, 3> begin;
+        std::array<size_type, 3> end;
+        auto next = lo;
+        for (size_type j = 0; j < children; ++j) {
+            begin[j] = next;
+            next += child_keys / children + (j < child_keys % children);
+            end[j] = next;
+            if (j + 1 < children) {
+                node->keys[j] = keys[next];
+                ++next;
+            }
+        }
+
+        // The children are independent, so build them on separate threads,
+        // each from a pool of its own.
+        std::array<NodePool<Node>, 3> pools;
+        for (auto& child : pools) {
+            child = NodePool<Node>(pool.pages());
+        }
+        parallel_invoke(children, threads, [&](size_type j, size_type budget) {
+            node->children[j] = build(keys, begin[j], end[j], height-1, budget, threads > 1 ? pools[j] : pool);
+        });
+        for (auto& child : pools) {
+            pool.adopt(std::move(child));
+        }
+
+        assert(node->ok());
+        return node;
+    }
+
+    // Copies the subtree into the pool in depth-first order.
+    static node_ptr clone(const node_ptr root, NodePool<Node>& pool) {
+        if (root == nullptr) {
+            return nullptr;
+        }
+
+        auto copy = pool.create(*root);
+        for (size_type j = 0; j < 3; ++j) {
+            copy->children[j] = clone(root->children[j], pool);
+        }
+        return copy;
+    }
+
+    // The number of nodes in the subtree.
+    static size_type nodes(const node_ptr root) {
+        if (root == nullptr) {
+            return 0;
+        }
+
+        size_type count = 1;
+        for (size_type j = 0; j < 3; ++j) {
+            count += nodes(root->children[j]);
+        }
+        return count;
+    }
+
 public:
-    TwoThreeTree() : m_root(nullptr), m_size(0) {}
+    TwoThreeTree() : m_root(nullptr), m_size(0), m_version(0) {}
+
+    // A tree whose nodes are allocated from pages of the given kind.
+    explicit TwoThreeTree(Pages pages) : m_pool(pages), m_root(nullptr), m_size(0), m_version(0) {}
+
+    // Copying is explicit, through clone().
+    TwoThreeTree(const TwoThreeTree&) = delete;
+    TwoThreeTree& operator=(const TwoThreeTree&) = delete;
+
+    // The other tree is left empty, without any memory of its own.
+    TwoThreeTree(TwoThreeTree&& other) noexcept
+        : m_pool(std::move(other.m_pool)), m_root(std::exchange(other.m_root, nullptr)),
+          m_size(std::exchange(other.m_size, 0)), m_version(++other.m_version) {}
+
+    TwoThreeTree& operator=(TwoThreeTree&& other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    // Fingers into either tree go stale, since both versions move past the
+    // versions they were taken at.
+    void swap(TwoThreeTree& other) noexcept {
+        const auto version = std::max(m_version, other.m_version) + 1;
+        m_pool.swap(other.m_pool);
+        std::swap(m_root, other.m_root);
+        std::swap(m_size, other.m_size);
+        m_version = other.m_version = version;
+    }
+
+    friend void swap(TwoThreeTree& a, TwoThreeTree& b) noexcept {
+        a.swap(b);
+    }
+
+    // Copies the tree into a single allocation, with the nodes laid out in
+    // depth-first order.
+    TwoThreeTree clone() const {
+        TwoThreeTree copy(m_pool.pages());
+        copy.m_pool.reserve(nodes(m_root));
+        copy.m_root = clone(m_root, copy.m_pool);
+        copy.m_size = m_size;
+        return copy;
+    }
 
     bool contains(key_type key) const {
         return contains(m_root, key);
     }
 
     std::optional<key_type> predecessor(key_type key) const {
-        const auto pred = predecessor(m_root, key);
-        if (pred == nullptr) {
-            return std::nullopt;
-        }
-        return *(std::lower_bound(pred->keys.begin(), pred->keys.begin() + pred->size, key) - 1);
+        return predecessor(m_root, key);
     }
 
     std::optional<key_type> successor(key_type key) const {
-        const auto succ = successor(m_root, key);
-        if (succ == nullptr) {
-            return std::nullopt;
-        }
-        return *std::upper_bound(succ->keys.begin(), succ->keys.begin() + succ->size, key);
+        return successor(m_root, key);
     }
 
     size_type size() const {
@@ -478,14 +619,79 @@ public:
         if (m_root->size == KICK) {
             m_root->size = 1;
         }
+        ++m_version;
         assert(contains(key));
     }
 
+    // Inserts the key starting from the leaf the finger was left at, and
+    // leaves the finger at the key. Runs of nearby keys, such as increasing or
+    // decreasing sequences, take amortized constant time.
+    void insert(Finger& finger, key_type key) {
+        if (m_root == nullptr) {
+            insert(key);
+            finger.depth = 0;
+        }
+
+        // Start over from the root if the finger is stale.
+        if (finger.owner != this || finger.version != m_version || finger.depth == 0) {
+            finger.owner = this;
+            finger.path[0] = {m_root, 0, 0, 0, false, false};
+            finger.depth = 1;
+            descend(finger, key);
+        }
+
+        // Walk up until the subtree can hold the key.
+        auto top = finger.depth - 1;
+        while (top > 0 && !finger.path[top].holds(key)) --top;
+
+        // Insert the key, then absorb kicked keys upwards until one fits.
+        auto child = finger.path[top].node;
+        auto root = insert(child, key);
+        while (top > 0 && (root != child || root->size == KICK)) {
+            --top;
+            auto parent = finger.path[top].node;
+            auto pivot = finger.path[top].index;
+            parent->children[pivot] = root;
+            child = parent;
+            root = root->size == KICK ? absorb(parent, pivot) : parent;
+        }
+        if (top == 0) {
+            m_root = root;
+            if (m_root->size == KICK) {
+                m_root->size = 1;
+            }
+        }
+
+        // Everything below the top might have moved, so find the key again.
+        finger.path[top].node = root;
+        finger.depth = top + 1;
+        descend(finger, key);
+        finger.version = ++m_version;
+        assert(contains(key));
+    }
+
+    // Builds the tree from unsorted keys that may contain duplicates, using up
+    // to the given number of threads. The tree must be empty.
+    template <class Iterator>
+    void build_parallel(Iterator first, Iterator last, size_type threads) {
+        assert(m_root == nullptr);
+        const auto keys = parallel_sort_unique(first, last, threads);
+        if (keys.empty()) return;
+
+        size_type height = 1;
+        while (capacity(height) < keys.size()) ++height;
+
+        m_root = build(keys, 0, keys.size(), height, threads, m_pool);
+        m_size = keys.size();
+        ++m_version;
+    }
+
     void remove(key_type key) {
         m_root = remove(m_root, key);
+        ++m_version;
         if (m_root != nullptr && m_root->size == HOLE) {
             auto root = m_root->children[0];
-            delete m_root;
+            m_pool.destroy(m_root);
             m_root = root;
         }
         assert(!contains(key));
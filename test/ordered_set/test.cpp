@@ -1,16 +1,31 @@
 #include <random>
 #include <limits>
+#include <set>
+#include <sstream>
 
 #include <gtest/gtest.h>
 
+#define BTREE_SUMS 1
+
 #include "../../src/ordered_set/avl_tree.hpp"
+#include "../../src/ordered_set/b_tree.hpp"
+#include "../../src/ordered_set/be_tree.hpp"
+#include "../../src/ordered_set/compressed_b_tree.hpp"
+#include "../../src/ordered_set/lsm_tree.hpp"
+#include "../../src/ordered_set/splay_tree.hpp"
 #include "../../src/ordered_set/two_three_tree.hpp"
 #include "../../src/ordered_set/stl_ordered_set.hpp"
-
-enum Op {
-    Insert,
-    Remove
-};
+#include "../../src/ordered_set/static_search_tree.hpp"
+#include "../../src/ordered_set/pgm_index.hpp"
+#include "../../src/ordered_set/elias_fano.hpp"
+#include "../../src/ordered_set/static_ordered_set.hpp"
+#include "../../src/ordered_set/sharded_ordered_set.hpp"
+#include "../../src/ordered_set/filtered_ordered_set.hpp"
+#include "../../src/ordered_set/roaring_set.hpp"
+#include "../../src/ordered_set/concurrent.hpp"
+#include "../../src/ordered_set/paged_b_tree.hpp"
+#include "../../src/ordered_set/adaptive_ordered_set.hpp"
+#include "../../src/ordered_set/trace.hpp"
 
 template <class OrderedSet>
 class OrderedSetTest : public testing::Test {
@@ -42,19 +57,7 @@ protected:
                 break;
             }
 
-            auto op = ops[i];
-            auto key = keys[i];
-
-            switch (op) {
-                case Op::Insert:
-                    stl_set.insert(key);
-                    set.insert(key);
-                    break;
-                case Op::Remove:
-                    stl_set.remove(key);
-                    set.remove(key);
-                    break;
-            }
+            ASSERT_EQ(apply(stl_set, ops[i], keys[i]), apply(set, ops[i], keys[i]));
         }
     }
 };
@@ -217,5 +220,1269 @@ REGISTER_TYPED_TEST_SUITE_P(OrderedSetTest,
     InsertRemoveRng
 );
 
-typedef testing::Types<TwoThreeTree, AVLTree> OrderedSetImplementations;
+typedef testing::Types<
+    TwoThreeTree, AVLTree, BTree, BeTree<>,
+    LsmTree<BTree, 64>, LsmTree<AVLTree, 64>, SplayTree<>, SplayTree<true>,
+    ShardedOrderedSet<BTree>, ShardedOrderedSet<AVLTree>,
+    FilteredOrderedSet<BTree>, FilteredOrderedSet<AVLTree>,
+    CompressedBTree<>, CompressedBTree<4, 2>, RoaringSet,
+    Concurrent<BTree>, PagedBTree<256>,
+    AdaptiveOrderedSet<>, AdaptiveOrderedSet<AVLTree, 4>
+> OrderedSetImplementations;
 INSTANTIATE_TYPED_TEST_SUITE_P(OrderedSetTestSuite, OrderedSetTest, OrderedSetImplementations);
+
+
+template <class StaticSet>
+class StaticSetTest : public testing::Test {
+protected:
+    using key_type = typename StaticSet::key_type;
+    using size_type = typename StaticSet::size_type;
+
+    static constexpr size_type size = 1024;
+
+protected:
+    StaticSetTest() { }
+    ~StaticSetTest() override { }
+
+    void check(const std::vector<key_type>& keys) {
+        StlOrderedSet stl_set;
+        for (const auto key : keys) {
+            stl_set.insert(key);
+        }
+
+        const auto set = StaticSet::from(stl_set);
+        ASSERT_EQ(stl_set.size(), set.size());
+
+        for (const auto key : keys) {
+            for (const auto query : {key - 1, key, key + 1}) {
+                ASSERT_EQ(stl_set.contains(query), set.contains(query));
+                ASSERT_EQ(stl_set.predecessor(query), set.predecessor(query));
+                ASSERT_EQ(stl_set.successor(query), set.successor(query));
+            }
+        }
+    }
+};
+
+TYPED_TEST_SUITE_P(StaticSetTest);
+
+TYPED_TEST_P(StaticSetTest, Empty) {
+    using key_type = typename TypeParam::key_type;
+
+    TypeParam set(std::vector<key_type>{});
+    ASSERT_EQ(0, set.size());
+    ASSERT_FALSE(set.contains(0));
+    ASSERT_EQ(std::nullopt, set.predecessor(0));
+    ASSERT_EQ(std::nullopt, set.successor(0));
+}
+
+TYPED_TEST_P(StaticSetTest, Sizes) {
+    using key_type = typename TypeParam::key_type;
+
+    for (key_type n = 1; n <= 130; ++n) {
+        std::vector<key_type> keys;
+        for (key_type i = 0; i < n; ++i) {
+            keys.push_back(2 * i + 1);
+        }
+        this->check(keys);
+    }
+}
+
+TYPED_TEST_P(StaticSetTest, Rng) {
+    using key_type = typename TypeParam::key_type;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<key_type> dist(
+        std::numeric_limits<key_type>::min(),
+        std::numeric_limits<key_type>::max()
+    );
+
+    std::vector<key_type> keys{
+        std::numeric_limits<key_type>::min(),
+        std::numeric_limits<key_type>::max()
+    };
+    for (key_type i = 0; i < this->size; ++i) {
+        keys.push_back(dist(rng));
+    }
+
+    this->check(keys);
+}
+
+REGISTER_TYPED_TEST_SUITE_P(StaticSetTest,
+    Empty, Sizes, Rng
+);
+
+typedef testing::Types<BfsSearchTree, VebSearchTree, PgmIndex<>, PgmIndex<1, 1>, EliasFano> StaticSetImplementations;
+INSTANTIATE_TYPED_TEST_SUITE_P(StaticSetTestSuite, StaticSetTest, StaticSetImplementations);
+
+// Tables known at compile time answer at compile time.
+static_assert(static_ordered_set<65535, 0, 1024, 1>.size() == 4);
+static_assert(static_ordered_set<65535, 0, 1024, 1>.contains(1024));
+static_assert(!static_ordered_set<65535, 0, 1024, 1>.contains(1023));
+static_assert(static_ordered_set<65535, 0, 1024, 1>.predecessor(1024) == 1);
+static_assert(static_ordered_set<65535, 0, 1024, 1>.successor(1024) == 65535);
+static_assert(!static_ordered_set<65535, 0, 1024, 1>.predecessor(0).has_value());
+static_assert(!static_ordered_set<>.contains(0));
+
+template <class Size>
+class StaticOrderedSetTest : public testing::Test {};
+
+TYPED_TEST_SUITE_P(StaticOrderedSetTest);
+
+// The odd keys below 2N, given in decreasing order.
+template <size_t N>
+constexpr std::array<uint64_t, N> odd_keys() {
+    std::array<uint64_t, N> keys{};
+    for (size_t i = 0; i < N; ++i) {
+        keys[i] = 2 * (N - i) - 1;
+    }
+    return keys;
+}
+
+// A table of every size answers like std::set, whether it was built at
+// compile time or at run time from shuffled keys.
+TYPED_TEST_P(StaticOrderedSetTest, Sizes) {
+    static constexpr size_t N = TypeParam::value;
+    static constexpr StaticOrderedSet<N> odd(odd_keys<N>());
+
+    StlOrderedSet stl_set;
+    for (const auto key : odd_keys<N>()) {
+        stl_set.insert(key);
+    }
+    ASSERT_EQ(stl_set.size(), odd.size());
+    for (uint64_t key = 0; key <= 2 * N + 1; ++key) {
+        ASSERT_EQ(stl_set.contains(key), odd.contains(key));
+        ASSERT_EQ(stl_set.predecessor(key), odd.predecessor(key));
+        ASSERT_EQ(stl_set.successor(key), odd.successor(key));
+    }
+
+    std::mt19937_64 rng(N);
+    std::set<uint64_t> keys{0, std::numeric_limits<uint64_t>::max()};
+    while (keys.size() < N) {
+        keys.insert(rng());
+    }
+    std::array<uint64_t, N> shuffled{};
+    std::copy_n(keys.begin(), N, shuffled.begin());
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    const StaticOrderedSet<N> set(shuffled);
+    StlOrderedSet random_set;
+    for (const auto key : shuffled) {
+        random_set.insert(key);
+    }
+    for (const auto key : shuffled) {
+        for (const auto query : {key - 1, key, key + 1}) {
+            ASSERT_EQ(random_set.contains(query), set.contains(query));
+            ASSERT_EQ(random_set.predecessor(query), set.predecessor(query));
+            ASSERT_EQ(random_set.successor(query), set.successor(query));
+        }
+    }
+}
+
+REGISTER_TYPED_TEST_SUITE_P(StaticOrderedSetTest, Sizes);
+
+template <size_t N>
+using Size = std::integral_constant<size_t, N>;
+
+typedef testing::Types<
+    Size<0>, Size<1>, Size<2>, Size<3>, Size<7>, Size<8>, Size<9>, Size<64>, Size<100>, Size<1000>
+> StaticOrderedSetSizes;
+INSTANTIATE_TYPED_TEST_SUITE_P(StaticOrderedSetTestSuite, StaticOrderedSetTest, StaticOrderedSetSizes);
+
+TEST(ShardedOrderedSetTest, NoShards) {
+    ShardedOrderedSet<BTree> set(0);
+    set.insert(7);
+    set.insert_batch({1, 9});
+    ASSERT_EQ(3, set.size());
+    ASSERT_TRUE(set.contains(9));
+    ASSERT_EQ(7, set.successor(1));
+}
+
+TEST(ShardedOrderedSetTest, Batch) {
+    using key_type = ShardedOrderedSet<BTree>::key_type;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<key_type> dist(0, 1 << 16);
+
+    ShardedOrderedSet<BTree> set(4);
+    StlOrderedSet stl_set;
+
+    for (size_t round = 0; round < 16; ++round) {
+        std::vector<key_type> inserts;
+        std::vector<key_type> removes;
+        for (size_t i = 0; i < 512; ++i) {
+            inserts.push_back(dist(rng));
+            removes.push_back(dist(rng));
+        }
+
+        set.insert_batch(inserts);
+        for (const auto key : inserts) stl_set.insert(key);
+        set.remove_batch(removes);
+        for (const auto key : removes) stl_set.remove(key);
+
+        ASSERT_EQ(stl_set.size(), set.size());
+        for (const auto key : inserts) {
+            ASSERT_EQ(stl_set.contains(key), set.contains(key));
+            ASSERT_EQ(stl_set.predecessor(key), set.predecessor(key));
+            ASSERT_EQ(stl_set.successor(key), set.successor(key));
+        }
+    }
+
+    // The keys are all in the first shard's initial range, so the shards
+    // must have been rebalanced.
+    for (size_t i = 0; i < set.shards(); ++i) {
+        ASSERT_LE(set.shard(i).size(), 2 * set.size() / set.shards());
+    }
+}
+
+template <class OrderedSet>
+class BuildTest : public testing::Test {
+protected:
+    using key_type = typename OrderedSet::key_type;
+    using size_type = typename OrderedSet::size_type;
+
+protected:
+    BuildTest() { }
+    ~BuildTest() override { }
+
+    void check(const std::vector<key_type>& keys, size_type threads) {
+        OrderedSet set;
+        StlOrderedSet stl_set;
+
+        set.build_parallel(keys.begin(), keys.end(), threads);
+        for (const auto key : keys) {
+            stl_set.insert(key);
+        }
+
+        ASSERT_EQ(stl_set.size(), set.size());
+        for (const auto key : keys) {
+            ASSERT_EQ(stl_set.contains(key + 1), set.contains(key + 1));
+            ASSERT_EQ(stl_set.predecessor(key), set.predecessor(key));
+            ASSERT_EQ(stl_set.successor(key), set.successor(key));
+        }
+
+        // The tree must stay balanced under further updates.
+        for (const auto key : keys) {
+            stl_set.remove(key);
+            set.remove(key);
+            stl_set.insert(key / 2);
+            set.insert(key / 2);
+        }
+
+        ASSERT_EQ(stl_set.size(), set.size());
+        for (const auto key : keys) {
+            ASSERT_EQ(stl_set.contains(key / 2), set.contains(key / 2));
+            ASSERT_EQ(stl_set.predecessor(key), set.predecessor(key));
+            ASSERT_EQ(stl_set.successor(key), set.successor(key));
+        }
+    }
+};
+
+TYPED_TEST_SUITE_P(BuildTest);
+
+TYPED_TEST_P(BuildTest, Sizes) {
+    using key_type = typename TypeParam::key_type;
+
+    for (key_type n = 0; n <= 100; ++n) {
+        std::vector<key_type> keys;
+        for (key_type i = 0; i < n; ++i) {
+            keys.push_back((i * 37) % (n + 1));
+        }
+        this->check(keys, 1);
+    }
+}
+
+TYPED_TEST_P(BuildTest, Rng) {
+    using key_type = typename TypeParam::key_type;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<key_type> dist(0, 1 << 12);
+
+    std::vector<key_type> keys;
+    for (key_type i = 0; i < 1 << 13; ++i) {
+        keys.push_back(dist(rng));
+    }
+
+    for (const auto threads : {1, 3, 8}) {
+        this->check(keys, threads);
+    }
+}
+
+REGISTER_TYPED_TEST_SUITE_P(BuildTest,
+    Sizes, Rng
+);
+
+typedef testing::Types<TwoThreeTree, AVLTree, BTree> BuildImplementations;
+INSTANTIATE_TYPED_TEST_SUITE_P(BuildTestSuite, BuildTest, BuildImplementations);
+
+TEST(BTreeTest, Aggregates) {
+    using key_type = BTree::key_type;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<key_type> dist(0, 1 << 12);
+
+    BTree set;
+    std::set<key_type> stl_set;
+
+    for (size_t i = 0; i < 1 << 12; ++i) {
+        auto key = dist(rng);
+        if (i % 3 == 2) {
+            set.remove(key);
+            stl_set.erase(key);
+        } else {
+            set.insert(key);
+            stl_set.insert(key);
+        }
+
+        if (i % 64 != 0) continue;
+
+        for (size_t j = 0; j < 64; ++j) {
+            auto lo = dist(rng);
+            auto hi = dist(rng);
+            auto first = stl_set.lower_bound(lo);
+            auto last = stl_set.lower_bound(hi);
+
+            size_t count = 0;
+            key_type sum = 0;
+            for (auto it = first; lo < hi && it != last; ++it) {
+                ++count;
+                sum += *it;
+            }
+
+            ASSERT_EQ(std::distance(stl_set.begin(), first), set.rank(lo));
+            ASSERT_EQ(count, set.count_range(lo, hi));
+            ASSERT_EQ(sum, set.sum_range(lo, hi));
+        }
+
+        size_t k = 0;
+        for (const auto key : stl_set) {
+            ASSERT_EQ(key, set.select(k++));
+        }
+        ASSERT_EQ(std::nullopt, set.select(k));
+    }
+}
+
+// Batches spread over the whole tree, crowded into one subtree, and
+// emptying whole ranges, through the parallel path and the rebuild, with
+// single updates in between relying on the tree staying balanced.
+TEST(BTreeTest, Batch) {
+    using key_type = BTree::key_type;
+
+    static constexpr size_t THREADS = 4;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<key_type> dist(0, 1 << 16);
+
+    BTree set;
+    std::set<key_type> stl_set;
+
+    auto check = [&]() {
+        ASSERT_EQ(stl_set.size(), set.size());
+        size_t k = 0;
+        key_type sum = 0;
+        for (const auto key : stl_set) {
+            ASSERT_EQ(key, set.select(k++));
+            sum += key;
+        }
+        ASSERT_EQ(sum, set.sum_range(0, std::numeric_limits<key_type>::max()));
+        ASSERT_EQ(stl_set.empty() ? std::nullopt : std::make_optional(*stl_set.begin()), set.min());
+        ASSERT_EQ(stl_set.empty() ? std::nullopt : std::make_optional(*stl_set.rbegin()), set.max());
+        for (size_t i = 0; i < 1 << 10; ++i) {
+            auto key = dist(rng);
+            ASSERT_EQ(stl_set.contains(key), set.contains(key));
+            ASSERT_EQ(std::distance(stl_set.begin(), stl_set.lower_bound(key)), set.rank(key));
+        }
+    };
+
+    auto insert_batch = [&](const std::vector<key_type>& keys) {
+        set.insert_batch(keys, THREADS);
+        stl_set.insert(keys.begin(), keys.end());
+    };
+
+    auto remove_batch = [&](const std::vector<key_type>& keys) {
+        set.remove_batch(keys, THREADS);
+        for (const auto key : keys) {
+            stl_set.erase(key);
+        }
+    };
+
+    std::vector<key_type> keys;
+    for (size_t i = 0; i < 1 << 14; ++i) {
+        keys.push_back(dist(rng));
+    }
+    insert_batch(keys);
+    check();
+
+    for (size_t round = 0; round < 8; ++round) {
+        // Spread out.
+        keys.clear();
+        for (size_t i = 0; i < 1 << 13; ++i) {
+            keys.push_back(dist(rng));
+        }
+        insert_batch(keys);
+        check();
+
+        // Crowded, or emptying a range.
+        const auto lo = dist(rng);
+        keys.clear();
+        for (key_type key = lo; key < lo + (1 << 13); ++key) {
+            keys.push_back(key);
+        }
+        if (round % 2 == 0) {
+            insert_batch(keys);
+        } else {
+            remove_batch(keys);
+        }
+        check();
+
+        keys.clear();
+        for (size_t i = 0; i < 1 << 13; ++i) {
+            keys.push_back(dist(rng));
+        }
+        remove_batch(keys);
+        check();
+
+        for (size_t i = 0; i < 1 << 10; ++i) {
+            auto key = dist(rng);
+            if (i % 2 == 0) {
+                set.insert(key);
+                stl_set.insert(key);
+            } else {
+                set.remove(key);
+                stl_set.erase(key);
+            }
+        }
+        check();
+    }
+
+    // Larger than the tree, so it is rebuilt.
+    keys.assign(stl_set.begin(), stl_set.end());
+    remove_batch(keys);
+    check();
+}
+
+// Enough updates to fill the buffers at every level, with queries between
+// them that must see the messages still pending above the leaves.
+TEST(BeTreeTest, Buffers) {
+    using key_type = BeTree<>::key_type;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<key_type> dist(0, 1 << 14);
+
+    BeTree<> set;
+    std::set<key_type> stl_set;
+
+    for (size_t i = 0; i < 1 << 16; ++i) {
+        auto key = dist(rng);
+        if (i % 3 == 2) {
+            set.remove(key);
+            stl_set.erase(key);
+        } else {
+            set.insert(key);
+            stl_set.insert(key);
+        }
+
+        if (i % 1024 != 0) continue;
+
+        for (size_t j = 0; j < 256; ++j) {
+            auto query = dist(rng);
+            auto it = stl_set.lower_bound(query);
+            auto pred = it != stl_set.begin() ? std::make_optional(*std::prev(it)) : std::nullopt;
+            if (it != stl_set.end() && *it == query) ++it;
+            auto succ = it != stl_set.end() ? std::make_optional(*it) : std::nullopt;
+
+            ASSERT_EQ(stl_set.count(query) == 1, set.contains(query));
+            ASSERT_EQ(pred, set.predecessor(query));
+            ASSERT_EQ(succ, set.successor(query));
+        }
+    }
+
+    ASSERT_EQ(stl_set.size(), set.size());
+    ASSERT_GT(set.flushed(), 0);
+
+    // Moves hand the tree over and leave an empty one that still works.
+    BeTree<> moved(std::move(set));
+    ASSERT_EQ(stl_set.size(), moved.size());
+    ASSERT_EQ(0, set.size());
+    ASSERT_EQ(std::nullopt, set.successor(0));
+    set.insert(1);
+    ASSERT_TRUE(set.contains(1));
+
+    set = std::move(moved);
+    ASSERT_EQ(stl_set.size(), set.size());
+    moved.swap(set);
+    ASSERT_EQ(stl_set.size(), moved.size());
+    ASSERT_EQ(1, set.size());
+}
+
+// Enough updates for several rounds of compaction, with queries between
+// them that must merge the memtable and every run.
+TEST(LsmTreeTest, Compaction) {
+    using key_type = LsmTree<>::key_type;
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<key_type> dist(0, 1 << 14);
+
+    LsmTree<BTree, 256> set;
+    std::set<key_type> stl_set;
+
+    for (size_t i = 0; i < 1 << 16; ++i) {
+        auto key = dist(rng);
+        if (i % 3 == 2) {
+            set.remove(key);
+            stl_set.erase(key);
+        } else {
+            set.insert(key);
+            stl_set.insert(key);
+        }
+
+        if (i % 1024 != 0) continue;
+
+        ASSERT_EQ(stl_set.size(), set.size());
+        for (size_t j = 0; j < 256; ++j) {
+            auto query = dist(rng);
+            auto it = stl_set.lower_bound(query);
+            auto pred = it != stl_set.begin() ? std::make_optional(*std::prev(it)) : std::nullopt;
+            if (it != stl_set.end() && *it == query) ++it;
+            auto succ = it != stl_set.end() ? std::make_optional(*it) : std::nullopt;
+
+            ASSERT_EQ(stl_set.count(query) == 1, set.contains(query));
+            ASSERT_EQ(pred, set.predecessor(query));
+            ASSERT_EQ(succ, set.successor(query));
+        }
+    }
+
+    ASSERT_EQ(stl_set.size(), set.size());
+    ASSERT_LE(set.runs(), decltype(set)::MAX_RUNS);
+}
+
+// No false negatives after churn, and few false positives at the default
+// sizing.
+TEST(BloomFilterTest, FalsePositives) {
+    using key_type = CountingBloomFilter::key_type;
+
+    std::mt19937_64 rng(0);
+    std::vector<key_type> keys(1 << 16);
+    for (auto& key : keys) {
+        key = rng();
+    }
+
+    CountingBloomFilter filter(keys.size(), 16, 8);
+    for (const auto key : keys) {
+        filter.insert(key);
+    }
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        filter.remove(keys[i]);
+    }
+    for (size_t i = 1; i < keys.size(); i += 2) {
+        ASSERT_TRUE(filter.may_contain(keys[i]));
+    }
+
+    size_t positives = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        positives += filter.may_contain(rng());
+    }
+    ASSERT_LT(positives, keys.size() / 100);
+}
+
+// Clustered keys with small gaps pack into a few bits each, while keys far
+// apart still split into leaves of their own.
+TEST(CompressedBTreeTest, Memory) {
+    using key_type = CompressedBTree<>::key_type;
+
+    std::mt19937_64 rng(0);
+    CompressedBTree<> set;
+    std::set<key_type> stl_set;
+
+    key_type key = 0;
+    for (size_t i = 0; i < 1 << 16; ++i) {
+        key += 1 + rng() % 16;
+        set.insert(key);
+        stl_set.insert(key);
+    }
+    ASSERT_LT(set.memory(), 2 * set.size());
+
+    for (size_t i = 0; i < 1 << 10; ++i) {
+        key = rng();
+        set.insert(key);
+        stl_set.insert(key);
+    }
+    for (size_t i = 0; i < 1 << 12; ++i) {
+        auto it = std::next(stl_set.begin(), rng() % stl_set.size());
+        set.remove(*it);
+        stl_set.erase(it);
+    }
+
+    ASSERT_EQ(stl_set.size(), set.size());
+    for (const auto key : stl_set) {
+        ASSERT_TRUE(set.contains(key));
+        ASSERT_EQ(key, set.successor(key - 1));
+        ASSERT_EQ(key, set.predecessor(key + 1));
+    }
+
+    // Moving leaves an empty tree without a root, which still works.
+    const auto size = set.size();
+    CompressedBTree<> moved(std::move(set));
+    ASSERT_EQ(size, moved.size());
+    ASSERT_EQ(0, set.size());
+    ASSERT_EQ(0, set.memory());
+    ASSERT_FALSE(set.contains(key));
+    ASSERT_FALSE(set.successor(0).has_value());
+    set.remove(key);
+    set.insert(key);
+    ASSERT_TRUE(set.contains(key));
+
+    set = std::move(moved);
+    ASSERT_EQ(size, set.size());
+}
+
+// Keys that lie close to a few lines need a segment or so per line, while
+// a tiny error forces many segments over several levels, and lookups come
+// out the same either way.
+TEST(PgmIndexTest, Segments) {
+    using key_type = PgmIndex<>::key_type;
+
+    std::mt19937_64 rng(0);
+    std::vector<key_type> keys;
+    for (key_type line = 0; line < 4; ++line) {
+        auto key = line << 40;
+        for (key_type i = 0; i < 1 << 14; ++i) {
+            key += (line + 1) * (1 + rng() % 64);
+            keys.push_back(key);
+        }
+    }
+
+    const PgmIndex<> smooth(keys);
+    ASSERT_EQ(keys.size(), smooth.size());
+    ASSERT_LE(smooth.segments(), 16);
+    ASSERT_LT(smooth.index_memory(), keys.size());
+
+    const PgmIndex<1, 1> rough(keys);
+    ASSERT_GT(rough.segments(), 1024);
+
+    const std::set<key_type> stl_set(keys.begin(), keys.end());
+    for (size_t i = 0; i < 1 << 14; ++i) {
+        const auto key = keys[rng() % keys.size()] + rng() % 65 - 32;
+        auto it = stl_set.lower_bound(key);
+        const auto contains = it != stl_set.end() && *it == key;
+        const auto predecessor = it == stl_set.begin() ? std::nullopt : std::make_optional(*std::prev(it));
+        auto next = stl_set.upper_bound(key);
+        const auto successor = next == stl_set.end() ? std::nullopt : std::make_optional(*next);
+        ASSERT_EQ(contains, smooth.contains(key));
+        ASSERT_EQ(contains, rough.contains(key));
+        ASSERT_EQ(predecessor, smooth.predecessor(key));
+        ASSERT_EQ(predecessor, rough.predecessor(key));
+        ASSERT_EQ(successor, smooth.successor(key));
+        ASSERT_EQ(successor, rough.successor(key));
+    }
+}
+
+// The encoding takes about 2 + log(U / n) bits per key, and ranks, selects
+// and iteration agree with the sorted keys, whichever set it was built from.
+TEST(EliasFanoTest, RankSelect) {
+    using key_type = EliasFano::key_type;
+
+    std::mt19937_64 rng(0);
+    AVLTree avl_tree;
+    TwoThreeTree two_three_tree;
+    BTree b_tree;
+    std::set<key_type> stl_set;
+    for (size_t i = 0; i < 1 << 14; ++i) {
+        // Dense runs now and then, so that some buckets are long.
+        const auto key = i % 1024 < 64 ? i << 20 : rng() >> 24;
+        avl_tree.insert(key);
+        two_three_tree.insert(key);
+        b_tree.insert(key);
+        stl_set.insert(key);
+    }
+    const std::vector<key_type> keys(stl_set.begin(), stl_set.end());
+
+    const auto set = EliasFano::from(avl_tree);
+    ASSERT_EQ(keys.size(), set.size());
+    ASSERT_LT(8 * set.memory(), (3 + std::bit_width(keys.back() / keys.size())) * keys.size());
+    ASSERT_TRUE(std::equal(set.begin(), set.end(), keys.begin(), keys.end()));
+    ASSERT_TRUE(std::equal(set.begin(), set.end(), EliasFano::from(two_three_tree).begin()));
+    ASSERT_TRUE(std::equal(set.begin(), set.end(), EliasFano::from(b_tree).begin()));
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        ASSERT_EQ(keys[i], set.select(i));
+        ASSERT_EQ(i, set.rank(keys[i]));
+    }
+    for (size_t i = 0; i < 1 << 14; ++i) {
+        const auto key = rng() >> 24;
+        const auto rank = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        ASSERT_EQ(rank, set.rank(key));
+    }
+}
+
+// A tree many times the size of its buffer pool keeps answering like
+// std::set through inserts and removes, pages in and out as it goes, and
+// scans ranges in order.
+TEST(PagedBTreeTest, Budget) {
+    using key_type = PagedBTree<256>::key_type;
+
+    static constexpr size_t BUDGET = 8 * 256;
+
+    std::mt19937_64 rng(0);
+    PagedBTree<256> set(BUDGET);
+    std::set<key_type> stl_set;
+    for (size_t i = 0; i < 1 << 15; ++i) {
+        const auto key = rng() % (1 << 14);
+        if (rng() % 3 == 0) {
+            set.remove(key);
+            stl_set.erase(key);
+        } else {
+            set.insert(key);
+            stl_set.insert(key);
+        }
+    }
+    ASSERT_LE(set.memory(), BUDGET);
+    ASSERT_GT(set.reads(), 0);
+    ASSERT_GT(set.writes(), 0);
+
+    ASSERT_EQ(stl_set.size(), set.size());
+    for (key_type key = 0; key <= 1 << 14; ++key) {
+        ASSERT_EQ(stl_set.contains(key), set.contains(key));
+        auto it = stl_set.lower_bound(key);
+        ASSERT_EQ(it == stl_set.begin() ? std::nullopt : std::make_optional(*std::prev(it)), set.predecessor(key));
+        auto next = stl_set.upper_bound(key);
+        ASSERT_EQ(next == stl_set.end() ? std::nullopt : std::make_optional(*next), set.successor(key));
+    }
+
+    std::vector<key_type> scanned;
+    set.scan(1000, 9000, [&](key_type key) { scanned.push_back(key); });
+    ASSERT_TRUE(std::equal(scanned.begin(), scanned.end(), stl_set.lower_bound(1000), stl_set.lower_bound(9000)));
+
+    // Removing every key leaves an empty root.
+    for (const auto key : stl_set) {
+        set.remove(key);
+    }
+    ASSERT_EQ(0, set.size());
+    ASSERT_FALSE(set.successor(0).has_value());
+}
+
+// Containers turn into bitmaps as they fill up, into runs when the keys are
+// contiguous, and back into arrays as they empty, answering the same all
+// along.
+TEST(RoaringSetTest, Containers) {
+    using key_type = RoaringSet::key_type;
+
+    std::mt19937_64 rng(0);
+    RoaringSet set;
+    std::set<key_type> stl_set;
+
+    auto check = [&]() {
+        ASSERT_EQ(stl_set.size(), set.size());
+        const std::vector<key_type> keys(stl_set.begin(), stl_set.end());
+        for (size_t i = 0; i < 1 << 12; ++i) {
+            auto key = keys[rng() % keys.size()] + rng() % 5 - 2;
+            auto it = stl_set.lower_bound(key);
+            ASSERT_EQ(it != stl_set.end() && *it == key, set.contains(key));
+            ASSERT_EQ(it == stl_set.begin() ? std::nullopt : std::make_optional(*std::prev(it)), set.predecessor(key));
+            auto next = stl_set.upper_bound(key);
+            ASSERT_EQ(next == stl_set.end() ? std::nullopt : std::make_optional(*next), set.successor(key));
+        }
+    };
+
+    // Dense keys with a few holes, about a bit each.
+    for (key_type key = 0; key < 3 << 16; ++key) {
+        if (rng() % 8 == 0) continue;
+        set.insert(key);
+        stl_set.insert(key);
+    }
+    ASSERT_LT(8 * set.memory(), 2 * set.size());
+    check();
+
+    // Contiguous keys, a few bytes per run.
+    const auto base = key_type(1) << 40;
+    for (key_type key = base; key < base + (2 << 16); ++key) {
+        set.insert(key);
+        stl_set.insert(key);
+    }
+    ASSERT_LT(8 * set.memory(), 2 * (3 << 16));
+    check();
+
+    // Thin both out until they are sparse again.
+    std::vector<key_type> keys(stl_set.begin(), stl_set.end());
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (size_t i = 0; i < 31 * keys.size() / 32; ++i) {
+        set.remove(keys[i]);
+        stl_set.erase(keys[i]);
+    }
+    check();
+    for (const auto key : stl_set) {
+        ASSERT_TRUE(set.contains(key));
+    }
+}
+
+// A set moves between its representations as it grows and shrinks, and
+// answers the same in each.
+TEST(AdaptiveOrderedSetTest, Representations) {
+    using Set = AdaptiveOrderedSet<>;
+    using key_type = Set::key_type;
+    static_assert(sizeof(Set) == 24);
+
+    std::mt19937_64 rng(0);
+    Set set;
+    std::set<key_type> stl_set;
+
+    auto check = [&]() {
+        ASSERT_EQ(stl_set.size(), set.size());
+        for (const auto key : stl_set) {
+            for (const auto query : {key - 1, key, key + 1}) {
+                auto it = stl_set.lower_bound(query);
+                ASSERT_EQ(it != stl_set.end() && *it == query, set.contains(query));
+                ASSERT_EQ(it == stl_set.begin() ? std::nullopt : std::make_optional(*std::prev(it)), set.predecessor(query));
+                auto next = stl_set.upper_bound(query);
+                ASSERT_EQ(next == stl_set.end() ? std::nullopt : std::make_optional(*next), set.successor(query));
+            }
+        }
+    };
+
+    std::vector<key_type> keys;
+    for (size_t i = 0; i < 4 * Set::INLINE + 64; ++i) {
+        keys.push_back(rng() | 1);
+    }
+    // The top half of the keys, to check the biased comparisons.
+    keys[1] |= key_type(1) << 63;
+    keys[5] = std::numeric_limits<key_type>::max();
+
+    for (size_t i = 0; i < keys.size(); ++i) {
+        set.insert(keys[i]);
+        stl_set.insert(keys[i]);
+        if (i < Set::INLINE) {
+            ASSERT_EQ(Set::Representation::Inline, set.representation());
+            ASSERT_EQ(0, set.memory());
+        } else if (i < 64) {
+            ASSERT_EQ(Set::Representation::Array, set.representation());
+            ASSERT_LE(set.memory(), 2 * stl_set.size() * sizeof(key_type));
+        } else {
+            ASSERT_EQ(Set::Representation::Tree, set.representation());
+        }
+        check();
+    }
+
+    // Emptied, the set gives its memory back on the way down.
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (const auto key : keys) {
+        set.remove(key);
+        stl_set.erase(key);
+        if (stl_set.size() <= 16) {
+            ASSERT_NE(Set::Representation::Tree, set.representation());
+            ASSERT_LE(set.memory(), 4 * std::max<size_t>(stl_set.size(), 4) * sizeof(key_type));
+        }
+        check();
+    }
+    ASSERT_EQ(Set::Representation::Inline, set.representation());
+}
+
+// A recorded trace survives the file format and replays to the same
+// answers. A file cut short keeps its complete records, while a damaged
+// header is rejected.
+TEST(TraceTest, RoundTrip) {
+    std::mt19937_64 rng(0);
+    RecordingOrderedSet<AVLTree> set;
+    std::vector<std::optional<Trace::key_type>> answers;
+    for (size_t i = 0; i < 1 << 12; ++i) {
+        auto op = static_cast<Op>(rng() % OPS);
+        auto key = rng() % 1024;
+        answers.push_back(apply(set, op, key));
+    }
+
+    std::stringstream stream;
+    ASSERT_TRUE(write_trace(stream, set.trace()));
+    auto bytes = stream.str();
+
+    auto trace = read_trace(stream);
+    ASSERT_TRUE(trace.has_value());
+    ASSERT_EQ(set.trace().ops, trace->ops);
+    ASSERT_EQ(set.trace().keys, trace->keys);
+
+    BTree replayed;
+    for (size_t i = 0; i < trace->size(); ++i) {
+        ASSERT_EQ(answers[i], apply(replayed, trace->ops[i], trace->keys[i]));
+    }
+
+    std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+    auto partial = read_trace(truncated);
+    ASSERT_TRUE(partial.has_value());
+    ASSERT_EQ(trace->size() - 1, partial->size());
+    ASSERT_TRUE(std::equal(partial->ops.begin(), partial->ops.end(), trace->ops.begin()));
+    ASSERT_TRUE(std::equal(partial->keys.begin(), partial->keys.end(), trace->keys.begin()));
+
+    bytes[0] = 'X';
+    std::stringstream corrupted(bytes);
+    ASSERT_FALSE(read_trace(corrupted).has_value());
+}
+
+template <class OrderedSet>
+class CloneTest : public testing::Test {};
+
+TYPED_TEST_SUITE_P(CloneTest);
+
+// A clone answers like the original and is independent of it, and moves
+// and swaps hand over the contents.
+TYPED_TEST_P(CloneTest, Rng) {
+    using key_type = typename TypeParam::key_type;
+
+    std::mt19937 rng;
+    std::uniform_int_distribution<key_type> dist(0, 1 << 12);
+
+    TypeParam set;
+    StlOrderedSet stl_set;
+    for (size_t i = 0; i < 1 << 12; ++i) {
+        auto key = dist(rng);
+        set.insert(key);
+        stl_set.insert(key);
+    }
+
+    auto clone = set.clone();
+    for (size_t i = 0; i < 1 << 12; ++i) {
+        set.remove(dist(rng));
+    }
+
+    ASSERT_EQ(stl_set.size(), clone.size());
+    for (key_type key = 0; key <= 1 << 12; ++key) {
+        ASSERT_EQ(stl_set.contains(key), clone.contains(key));
+        ASSERT_EQ(stl_set.predecessor(key), clone.predecessor(key));
+        ASSERT_EQ(stl_set.successor(key), clone.successor(key));
+    }
+
+    auto size = set.size();
+    TypeParam moved(std::move(set));
+    ASSERT_EQ(size, moved.size());
+    ASSERT_EQ(0, set.size());
+    ASSERT_FALSE(set.successor(0).has_value());
+    set.remove(0);
+
+    set.swap(moved);
+    ASSERT_EQ(size, set.size());
+    ASSERT_EQ(0, moved.size());
+
+    clone = std::move(set);
+    ASSERT_EQ(size, clone.size());
+    clone.insert(1 << 13);
+    ASSERT_TRUE(clone.contains(1 << 13));
+}
+
+REGISTER_TYPED_TEST_SUITE_P(CloneTest, Rng);
+
+typedef testing::Types<TwoThreeTree, AVLTree, BTree> CloneImplementations;
+INSTANTIATE_TYPED_TEST_SUITE_P(CloneTestSuite, CloneTest, CloneImplementations);
+
+template <class OrderedSet>
+class HugePagesTest : public testing::Test {};
+
+TYPED_TEST_SUITE_P(HugePagesTest);
+
+// A tree on huge pages answers like any other, whichever way its nodes were
+// allocated, and so do its clones and parallel builds.
+TYPED_TEST_P(HugePagesTest, Rng) {
+    using key_type = typename TypeParam::key_type;
+
+    std::mt19937 rng;
+    std::uniform_int_distribution<key_type> dist(0, 1 << 16);
+
+    TypeParam set(Pages::Huge);
+    StlOrderedSet stl_set;
+    for (size_t i = 0; i < 1 << 16; ++i) {
+        auto key = dist(rng);
+        set.insert(key);
+        stl_set.insert(key);
+        key = dist(rng);
+        set.remove(key);
+        stl_set.remove(key);
+    }
+
+    auto clone = set.clone();
+    ASSERT_EQ(stl_set.size(), clone.size());
+    for (key_type key = 0; key <= 1 << 16; ++key) {
+        ASSERT_EQ(stl_set.contains(key), set.contains(key));
+        ASSERT_EQ(stl_set.predecessor(key), clone.predecessor(key));
+        ASSERT_EQ(stl_set.successor(key), clone.successor(key));
+    }
+
+    std::vector<key_type> keys;
+    for (key_type key = 0; key < 1 << 16; key += 3) {
+        keys.push_back(key);
+    }
+    TypeParam built(Pages::Huge);
+    built.build_parallel(keys.begin(), keys.end(), 4);
+    ASSERT_EQ(keys.size(), built.size());
+    for (key_type key = 0; key < 1 << 16; ++key) {
+        ASSERT_EQ(key % 3 == 0, built.contains(key));
+    }
+}
+
+REGISTER_TYPED_TEST_SUITE_P(HugePagesTest, Rng);
+
+INSTANTIATE_TYPED_TEST_SUITE_P(HugePagesTestSuite, HugePagesTest, CloneImplementations);
+
+template <class OrderedSet>
+class PopTest : public testing::Test {};
+
+TYPED_TEST_SUITE_P(PopTest);
+
+// The cached ends follow every kind of update, and popping runs off either
+// end takes the same keys as a removal each would, leaving a tree that goes
+// on working.
+TYPED_TEST_P(PopTest, Rng) {
+    using key_type = typename TypeParam::key_type;
+
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<key_type> dist(0, 1 << 14);
+
+    std::vector<key_type> keys;
+    for (size_t i = 0; i < 1 << 12; ++i) {
+        keys.push_back(dist(rng));
+    }
+
+    TypeParam set;
+    set.build_parallel(keys.begin(), keys.end(), 2);
+    std::set<key_type> stl_set(keys.begin(), keys.end());
+
+    auto check = [&]() {
+        ASSERT_EQ(stl_set.size(), set.size());
+        ASSERT_EQ(stl_set.empty() ? std::nullopt : std::make_optional(*stl_set.begin()), set.min());
+        ASSERT_EQ(stl_set.empty() ? std::nullopt : std::make_optional(*stl_set.rbegin()), set.max());
+    };
+
+    for (size_t i = 0; i < 1 << 12; ++i) {
+        check();
+        switch (rng() % 5) {
+            case 0:
+            case 1:
+                for (auto j = rng() % 32; j < 32; ++j) {
+                    auto key = dist(rng);
+                    set.insert(key);
+                    stl_set.insert(key);
+                }
+                break;
+            case 2: {
+                // Mostly the ends, since those move the cache.
+                auto key = rng() % 2 == 0 || stl_set.empty() ? dist(rng) : rng() % 2 ? *stl_set.begin() : *stl_set.rbegin();
+                set.remove(key);
+                stl_set.erase(key);
+                break;
+            }
+            case 3: {
+                auto n = rng() % 2 ? rng() % 4 : rng() % 64;
+                std::vector<key_type> expected;
+                while (expected.size() < n && !stl_set.empty()) {
+                    expected.push_back(*stl_set.begin());
+                    stl_set.erase(stl_set.begin());
+                }
+                ASSERT_EQ(expected, set.pop_min(n));
+                break;
+            }
+            case 4: {
+                auto n = rng() % 2 ? rng() % 4 : rng() % 64;
+                std::vector<key_type> expected;
+                while (expected.size() < n && !stl_set.empty()) {
+                    expected.push_back(*stl_set.rbegin());
+                    stl_set.erase(std::prev(stl_set.end()));
+                }
+                ASSERT_EQ(expected, set.pop_max(n));
+                break;
+            }
+        }
+
+        if (i % 256 == 0) {
+            for (key_type key = 0; key <= 1 << 14; key += 7) {
+                auto it = stl_set.lower_bound(key);
+                ASSERT_EQ(it != stl_set.end() && *it == key, set.contains(key));
+                ASSERT_EQ(it == stl_set.begin() ? std::nullopt : std::make_optional(*std::prev(it)), set.predecessor(key));
+            }
+            if constexpr (std::is_same_v<TypeParam, BTree>) {
+                size_t k = 0;
+                for (const auto key : stl_set) {
+                    ASSERT_EQ(key, set.select(k++));
+                }
+            }
+        }
+    }
+
+    // Emptied from both ends at once, and refilled.
+    auto low = set.pop_min(set.size() / 2);
+    auto high = set.pop_max(set.size() + 1);
+    ASSERT_EQ(stl_set.size(), low.size() + high.size());
+    ASSERT_TRUE(std::is_sorted(low.begin(), low.end()));
+    ASSERT_TRUE(std::is_sorted(high.rbegin(), high.rend()));
+    stl_set.clear();
+    check();
+    ASSERT_TRUE(set.pop_min(1).empty());
+    set.insert(5);
+    set.insert(3);
+    stl_set = {3, 5};
+    check();
+}
+
+REGISTER_TYPED_TEST_SUITE_P(PopTest, Rng);
+
+typedef testing::Types<AVLTree, BTree> PopImplementations;
+INSTANTIATE_TYPED_TEST_SUITE_P(PopTestSuite, PopTest, PopImplementations);
+
+template <class OrderedSet>
+class ConcurrentTest : public testing::Test {};
+
+TYPED_TEST_SUITE_P(ConcurrentTest);
+
+// Threads update disjoint keys at once, so each one knows what its own
+// lookups must answer, and the set ends up with the union of their keys.
+TYPED_TEST_P(ConcurrentTest, Threads) {
+    using key_type = typename TypeParam::key_type;
+
+    static constexpr size_t THREADS = 8;
+
+    TypeParam set;
+    std::vector<std::set<key_type>> expected(THREADS);
+    std::atomic<size_t> mismatches = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+            std::mt19937 rng(t);
+            auto& own = expected[t];
+            for (size_t i = 0; i < 1 << 13; ++i) {
+                key_type key = (rng() % (1 << 11)) * THREADS + t;
+                switch (rng() % 4) {
+                    case 0:
+                        set.insert(key);
+                        own.insert(key);
+                        break;
+                    case 1:
+                        set.remove(key);
+                        own.erase(key);
+                        break;
+                    case 2:
+                        mismatches += set.contains(key) != own.contains(key);
+                        break;
+                    case 3:
+                        auto pred = set.predecessor(key);
+                        mismatches += pred.has_value() && *pred >= key;
+                        break;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(0, mismatches);
+
+    StlOrderedSet stl_set;
+    for (const auto& own : expected) {
+        for (const auto key : own) {
+            stl_set.insert(key);
+        }
+    }
+    ASSERT_EQ(stl_set.size(), set.size());
+    for (key_type key = 0; key < (1 << 11) * THREADS; ++key) {
+        ASSERT_EQ(stl_set.contains(key), set.contains(key));
+        ASSERT_EQ(stl_set.predecessor(key), set.predecessor(key));
+        ASSERT_EQ(stl_set.successor(key), set.successor(key));
+    }
+}
+
+REGISTER_TYPED_TEST_SUITE_P(ConcurrentTest, Threads);
+
+// Two slots leave most of the threads on the locked fallback.
+typedef testing::Types<
+    Concurrent<AVLTree>, Concurrent<TwoThreeTree>, Concurrent<BTree>,
+    Concurrent<StlOrderedSet>, Concurrent<AVLTree, 2>, Locked<AVLTree>
+> ConcurrentImplementations;
+INSTANTIATE_TYPED_TEST_SUITE_P(ConcurrentTestSuite, ConcurrentTest, ConcurrentImplementations);
+
+template <class OrderedSet>
+class FingerTest : public testing::Test {
+protected:
+    using key_type = typename OrderedSet::key_type;
+    using size_type = typename OrderedSet::size_type;
+
+    static constexpr size_type size = 1024;
+
+protected:
+    FingerTest() { }
+    ~FingerTest() override { }
+
+    void check(const std::vector<Op>& ops, const std::vector<key_type>& keys) {
+        assert(ops.size() == keys.size());
+
+        OrderedSet set;
+        StlOrderedSet stl_set;
+        typename OrderedSet::Finger finger;
+
+        for (size_t i = 0; i < ops.size(); ++i) {
+            switch (ops[i]) {
+                case Op::Insert:
+                    stl_set.insert(keys[i]);
+                    set.insert(finger, keys[i]);
+                    break;
+                default:
+                    ASSERT_EQ(apply(stl_set, ops[i], keys[i]), apply(set, ops[i], keys[i]));
+                    break;
+            }
+            ASSERT_EQ(stl_set.size(), set.size());
+        }
+
+        for (const auto key : keys) {
+            ASSERT_EQ(stl_set.contains(key), set.contains(key));
+            ASSERT_EQ(stl_set.predecessor(key), set.predecessor(key));
+            ASSERT_EQ(stl_set.successor(key), set.successor(key));
+        }
+    }
+};
+
+TYPED_TEST_SUITE_P(FingerTest);
+
+TYPED_TEST_P(FingerTest, InsertInc) {
+    using key_type = typename TypeParam::key_type;
+
+    std::vector<key_type> keys;
+    std::vector<Op> ops;
+    for (key_type i = 0; i < this->size; ++i) {
+        keys.push_back(i);
+        ops.push_back(Op::Insert);
+    }
+
+    this->check(ops, keys);
+}
+
+TYPED_TEST_P(FingerTest, InsertDec) {
+    using key_type = typename TypeParam::key_type;
+
+    std::vector<key_type> keys;
+    std::vector<Op> ops;
+    for (key_type i = 0; i < this->size; ++i) {
+        keys.push_back(this->size - i);
+        ops.push_back(Op::Insert);
+    }
+
+    this->check(ops, keys);
+}
+
+TYPED_TEST_P(FingerTest, InsertRemoveRng) {
+    using key_type = typename TypeParam::key_type;
+
+    // Keys wander around so the finger has to climb different distances.
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<int> step(-8, 16);
+    std::uniform_int_distribution<int> op(0, 7);
+
+    std::vector<key_type> keys;
+    std::vector<Op> ops;
+    key_type key = 1 << 20;
+    for (key_type i = 0; i < 4 * this->size; ++i) {
+        key += step(rng);
+        keys.push_back(key);
+        ops.push_back(op(rng) == 0 ? Op::Remove : Op::Insert);
+    }
+
+    this->check(ops, keys);
+}
+
+REGISTER_TYPED_TEST_SUITE_P(FingerTest,
+    InsertInc, InsertDec, InsertRemoveRng
+);
+
+typedef testing::Types<TwoThreeTree, AVLTree, BTree> FingerImplementations;
+INSTANTIATE_TYPED_TEST_SUITE_P(FingerTestSuite, FingerTest, FingerImplementations);
\ No newline at end of file